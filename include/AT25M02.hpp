@@ -1,16 +1,42 @@
 #ifndef AT25M02_H
 #define AT25M02_H
 
-#include "Arduino.h"
-#include "SPI.h"
+#include <HAL.hpp>
+#include <PDC.hpp>  // TxSegment
 
 /**
  * @file AT25M02.hpp
  * @brief Provides a library to interact with Microchip's AT25M02 chip.
  * This treats the chip as a circular queue that will not overwrite it's data.
  *
+ * Writes are buffered in SRAM a page at a time and programmed without waiting: a page program takes the chip ~5 ms,
+ * so poll() only starts the next one once READ_STATUS says the last one is done, and until then pages wait in the
+ * buffer. writeData() only has to wait if AT25M02_WRITE_PAGES pages pile up.
+ *
+ * With EepromTransport::HW_CS_DMA the SPI peripheral drives chip select and the page and the bytes of a READ go over
+ * the DMAC, so the 256 bytes of a page program (~0.5 ms at 5 MHz) stream to the chip while the FSM carries on, and
+ * DMAC_Handler() notes when they are done. The DMAC and the bus are shared with the sweep, which waits for them.
+ *
+ * Reads are served from a read-ahead buffer: when the bus and the chip are idle and no page is waiting to be
+ * programmed, poll() READs the front of the queue a page at a time into SRAM, so a replay's readData() is a memcpy.
  */
 
+// Pages writeData() can hold while the chip is busy with a write cycle: one filling and the rest waiting. A cycle stores
+// 140 bytes, so at the sample rate a page fills every other cycle and one waiting is plenty. Power of two.
+#ifndef AT25M02_WRITE_PAGES
+#define AT25M02_WRITE_PAGES 2
+#endif
+// Pages read ahead of readData(). A frame replays up to REPLAY_MAX (4) stored cycles of 140 bytes, so four pages hold
+// a frame's worth with room for the next page to come in. Power of two.
+#ifndef AT25M02_READ_PAGES
+#define AT25M02_READ_PAGES 4
+#endif
+// Builds in EepromTransport::HW_CS_DMA. Its frame buffer holds a page as 32-bit SPI words, 1040 bytes of SRAM, so
+// builds that stay on GPIO_CS leave it out.
+#ifndef AT25M02_DMA
+#define AT25M02_DMA 0
+#endif
+
 /**
  * @brief Commands for the AT25M02 chip. Pulled from the data sheet for this chip.
  * All commands are MSB first.
@@ -26,6 +52,18 @@ enum Command
 	WRITE_BYTE = 0x02,
 	WRITE_PAGE = 0x02
 };
+/**
+ * @brief How the AT25M02 driver reaches the chip.
+ * GPIO_CS - SPI.transfer calls, chip select driven with digitalWrite around each command. Everything blocks.
+ * HW_CS_DMA - the SPI peripheral drives chip select (NPCS1) itself. Short commands are single frames, the payload of
+ * a page program or READ is a DMA transfer. Page programs return as soon as the transfer is started. Only built with
+ * AT25M02_DMA.
+ */
+enum class EepromTransport : uint8_t{
+	GPIO_CS,
+	HW_CS_DMA
+};
+
 /**
  * @brief Interfaces with the AT25M02 EEPROM chip.
  */
@@ -35,6 +73,19 @@ class AT25M02
 		AT25M02(){};
 		void init();
 
+		/*
+		 * Chooses how the chip is reached, see EepromTransport. Call
+		 * after init(); the driver starts out on GPIO_CS, and stays
+		 * there if HW_CS_DMA is not built in (AT25M02_DMA).
+		 */
+		void set_transport(EepromTransport t);
+
+		/*
+		 * Call from DMAC_Handler in main.cpp: a page program's or
+		 * read-ahead's DMA transfer is done and the bus is free.
+		 */
+		void DMAC_Handler();
+
 		/*
 		 * Write from the given array to the memory. This data is
 		 * appended to the end of the queue.
@@ -44,6 +95,14 @@ class AT25M02
 		 */
 		bool writeData(byte* bytes, uint32_t length);
 
+		/*
+		 * Vectored writeData(): appends count segments as one record,
+		 * each copied once into the write buffer. Space for the whole
+		 * record is checked up front, so either all of it is queued
+		 * or none of it is and this returns false.
+		 */
+		bool writeData(const TxSegment* segments, size_t count);
+
 		/*
 		 * Write the given number of bytes from the ram into the
 		 * destination array. These bytes are taken from the start of
@@ -67,6 +126,16 @@ class AT25M02
 		 */
 		bool isReady();
 
+		/*
+		 * Programs the next buffered page if the chip has finished its
+		 * last write cycle, or if none is waiting reads the next page
+		 * ahead. Never waits. Call it whenever the FSM has slack
+		 * (waitForNewCycle). writeData() programs pages too, but
+		 * never reads ahead.
+		 * Returns true while full pages are still waiting.
+		 */
+		bool poll();
+
 	private:
 		/*
 		 * Reads the status register and returns the register
@@ -77,9 +146,31 @@ class AT25M02
 		uint32_t freeMemoryBytes();
 		uint32_t usedBufferBytes();
 		uint32_t freeBufferBytes();
+		uint32_t usedCacheBytes();
+		uint32_t freeCacheBytes();
 
 		uint32_t readWriteBuffer(byte *dest, uint32_t length);
+		void appendWriteBuffer(const byte *bytes, uint32_t length);
+		uint32_t readCache(byte *dest, uint32_t length);
 		uint32_t readMemory(byte *dest, uint32_t length);
+		void readAt(uint32_t addr, byte *dest, uint32_t length);
+#if AT25M02_DMA
+		void startRead(uint32_t addr, uint32_t length);
+#endif
+
+		/*
+		 * Reads from mem_start to the end of its page into the
+		 * read-ahead buffer, if it fits. Over DMA this only starts the
+		 * READ and collect() finishes it.
+		 */
+		void prefetch();
+		uint32_t prefetchLength();
+
+		/*
+		 * Moves a finished read-ahead from dma.rx into the read-ahead
+		 * buffer. Does nothing while it is still on the bus.
+		 */
+		void collect();
 
 		/*
 		 * Sets the Write Status Register
@@ -92,22 +183,75 @@ class AT25M02
 		void waitUntilReady();
 
 		/*
-		 * Writes are page buffered.
-		 * Partial page reads are supported.
+		 * Waits for a DMA transfer of ours to finish, in case
+		 * DMAC_Handler() has not run yet, and collect()s a read-ahead.
+		 */
+		void waitForTransfer();
+
+		/*
+		 * Writes are page buffered, in a ring of AT25M02_WRITE_PAGES
+		 * pages. wb_start and wb_end are free running, the position is
+		 * modulo the ring. Partial page reads are supported.
 		 * Start is inclusive, end is exclusive.
 		 */
-		uint8_t write_buffer[256];
+		uint8_t write_buffer[AT25M02_WRITE_PAGES * 256];
+		uint32_t wb_start;
 		uint32_t wb_end;
+		// Chip side of the queue, both in [0, RAM_SIZE). mem_end is
+		// page aligned. ram_full tells a full chip from an empty one
+		// when they are equal.
 		uint32_t mem_start;
 		uint32_t mem_end;
 		bool ram_full;
+		/*
+		 * Read-ahead buffer, in front of mem_start: the oldest bytes
+		 * of the queue. rb_start and rb_end are free running like
+		 * wb_start and wb_end. fetching is the length of a READ on the
+		 * bus into dma.rx, from mem_start, or 0.
+		 */
+		uint8_t read_buffer[AT25M02_READ_PAGES * 256];
+		uint32_t rb_start;
+		uint32_t rb_end;
+		uint32_t fetching;
+		// A page program was started and the chip has not been seen
+		// ready since.
+		bool writing;
+
+		hal::SpiSettings spi_settings;
+		EepromTransport transport;
+		// A DMA transfer of ours is on the bus. Cleared by
+		// DMAC_Handler() or waitForTransfer().
+		volatile bool transferring;
+#if AT25M02_DMA
+		// Frames of one DMA transfer: command, address and up to a
+		// page of data. Received frame i lands on bytes 2i and 2i+1,
+		// in transmit word i/2, which the DMAC has already sent.
+		union {
+			uint32_t tx[4 + 256];
+			uint16_t rx[4 + 256];
+		} dma;
+#endif
+
+		/*
+		 * Programs the page at the front of the write buffer at addr,
+		 * without caring about overwrite or waiting for the chip.
+		 */
+		void writePage(uint32_t addr);
 
-		SPISettings spi_settings;
+		/*
+		 * poll() without the read-ahead, for writeData().
+		 */
+		bool program();
+
+		/*
+		 * Starts a command: waits for the bus, then chip select low.
+		 */
+		void select();
 
 		/*
-		 * Just writes a page without caring about overwrite
+		 * One byte of a command. last ends it, chip select high.
 		 */
-		void writePage(uint32_t addr, byte* bytes, uint32_t length);
+		byte transfer(byte data, bool last = false);
 
 		/*
 		 * Chips select low => enabled on this chip.
@@ -0,0 +1,144 @@
+/**
+ * @file Cobs.hpp
+ * @brief Consistent Overhead Byte Stuffing with a CRC-16 trailer, for Framing::COBS records (see Telemetry.hpp).
+ *
+ * COBS rewrites a packet so it contains no zero bytes, at a cost of one byte per 254 plus one, and a zero then ends the
+ * packet. A receiver that lost its place only has to wait for the next zero. CobsEncoder encodes as the packet is built,
+ * a piece at a time straight into the output buffer, and runs the CRC over the same bytes on the way through, so the
+ * packet is only read once.
+ *
+ * CRC-16/CCITT-FALSE: polynomial 0x1021, initial value 0xFFFF, no reflection. The table is generated at compile time and
+ * lives in flash. The CRC goes after the data, low byte first like the rest of the record.
+ */
+#ifndef COBS_HPP
+#define COBS_HPP
+#include <stdint.h>
+#include <stddef.h>
+
+#define CRC16_INIT 0xFFFF
+#define CRC16_POLY 0x1021
+#define CRC16_LEN 2
+#define COBS_DELIMITER 0x00
+#define COBS_MAX_RUN 0xFF   // code byte for 254 data bytes and no zero
+
+namespace crc16 {
+    template <int... I> struct Indices {};
+    template <int N, int... I> struct MakeIndices : MakeIndices<N - 1, N - 1, I...> {};
+    template <int... I> struct MakeIndices<0, I...> { typedef Indices<I...> type; };
+
+    /**
+     * @brief crc shifted through bits more bits of the polynomial division.
+     */
+    constexpr uint16_t divide(uint16_t crc, int bits){
+        return bits == 0 ? crc : divide((crc & 0x8000) ? (uint16_t)((crc << 1) ^ CRC16_POLY) : (uint16_t)(crc << 1), bits - 1);
+    }
+
+    template <class = MakeIndices<256>::type> struct Table;
+
+    template <int... I>
+    struct Table<Indices<I...> > {
+        static constexpr uint16_t values[256] = { divide((uint16_t)(I << 8), 8)... };
+    };
+
+    template <int... I>
+    constexpr uint16_t Table<Indices<I...> >::values[256];
+
+    /**
+     * @brief crc carried on over one more byte.
+     */
+    inline uint16_t update(uint16_t crc, uint8_t byte){
+        return (uint16_t)((crc << 8) ^ Table<>::values[(uint8_t)(crc >> 8) ^ byte]);
+    }
+
+    /**
+     * @brief crc carried on over length more bytes. Start from CRC16_INIT.
+     */
+    inline uint16_t update(uint16_t crc, const uint8_t* data, size_t length){
+        for (size_t i = 0; i < length; i++){
+            crc = update(crc, data[i]);
+        }
+        return crc;
+    }
+}
+
+/**
+ * @brief Largest encoded packet, delimiter included, for length bytes of data and the CRC.
+ */
+constexpr size_t cobsEncodedSize(size_t length){
+    return length + CRC16_LEN + (length + CRC16_LEN) / (COBS_MAX_RUN - 1) + 2;
+}
+
+/**
+ * @brief Encodes one packet into a buffer of at least cobsEncodedSize() bytes.
+ * @code
+ * CobsEncoder packet(buffer);
+ * packet.put(&id, 1);
+ * packet.put(data, sizeof(data));
+ * uint8_t* end = packet.finish();
+ * @endcode
+ */
+class CobsEncoder {
+private:
+    uint8_t* code;  // where the code byte of the current run goes
+    uint8_t* out;
+    uint8_t run;    // code for the current run: data bytes in it + 1
+    uint16_t crc;
+
+    void stuff(uint8_t byte){
+        if (byte != 0){
+            *out++ = byte;
+            run++;
+            if (run != COBS_MAX_RUN) return;
+        }
+        *code = run;
+        code = out++;
+        run = 1;
+    }
+
+public:
+    explicit CobsEncoder(uint8_t* buffer) : code(buffer), out(buffer + 1), run(1), crc(CRC16_INIT) {}
+
+    void put(const void* data, size_t length){
+        const uint8_t* bytes = (const uint8_t*)data;
+        for (size_t i = 0; i < length; i++){
+            crc = crc16::update(crc, bytes[i]);
+            stuff(bytes[i]);
+        }
+    }
+
+    /**
+     * @brief Appends the CRC of everything put so far and the delimiter. Returns the end of the packet.
+     */
+    uint8_t* finish(){
+        uint16_t sum = crc;
+        stuff((uint8_t)sum);
+        stuff((uint8_t)(sum >> 8));
+        *code = run;
+        *out++ = COBS_DELIMITER;
+        return out;
+    }
+};
+
+/**
+ * @brief Decodes one packet, delimiter not included, and checks its CRC.
+ * @param out at least length bytes
+ * @return length of the data without the CRC, or -1 if the packet is malformed or the CRC does not match
+ */
+inline int cobsDecode(const uint8_t* in, size_t length, uint8_t* out){
+    const uint8_t* end = in + length;
+    uint8_t* start = out;
+    while (in < end){
+        uint8_t run = *in++;
+        if (run == COBS_DELIMITER || run - 1 > end - in) return -1;
+        for (uint8_t i = 1; i < run; i++){
+            if (*in == COBS_DELIMITER) return -1;
+            *out++ = *in++;
+        }
+        if (run != COBS_MAX_RUN && in < end) *out++ = 0;
+    }
+    int decoded = (int)(out - start) - CRC16_LEN;
+    if (decoded < 0) return -1;
+    uint16_t sum = start[decoded] | (uint16_t)(start[decoded + 1] << 8);
+    return crc16::update(CRC16_INIT, start, decoded) == sum ? decoded : -1;
+}
+#endif
@@ -0,0 +1,58 @@
+/**
+ * @file Counters.hpp
+ * @brief Housekeeping counters: link, EEPROM and timing events the drivers and interrupt handlers count as they happen,
+ * sent to the ground in the ##H record (see Telemetry.hpp).
+ *
+ * A counter is one uint32_t in a global table, so counting is a load, an add and a store, cheap enough for TC0_Handler
+ * and PDC::send_gather(). There are no locks: each counter is only written from one context, or with interrupts off (the
+ * comment on each says where), and 32-bit reads and writes are atomic on the Cortex-M3. Counters run from start up and
+ * wrap at 2^32, so the ground differences them. Gauges (EEPROM use) and high water marks are set rather than added to.
+ *
+ * sendData() copies the table into the frame with interrupts off, so a record never shows half an update.
+ */
+#ifndef COUNTERS_HPP
+#define COUNTERS_HPP
+#include <stdint.h>
+
+/**
+ * @brief The counters, in the order the ##H record sends them. The record is sized by NUM_COUNTERS, so like every other
+ * layout the ground decoder has to be built from the same tree as the firmware.
+ */
+enum Counter {
+    COUNTER_UART_FRAMES,       // frames queued on the UART (PDC::send_gather)
+    COUNTER_UART_BYTES,        // bytes in them
+    COUNTER_UART_REJECTED,     // frames dropped because the PDC ring was full
+    COUNTER_UART_SENT,         // frames the PDC finished sending (PDC::retire, interrupts off)
+    COUNTER_PDC_MAX_DEPTH,     // most segments ever waiting in the PDC ring, high water mark
+    COUNTER_EEPROM_WRITTEN,    // bytes stored (AT25M02::writeData)
+    COUNTER_EEPROM_REJECTED,   // writes refused because the EEPROM was full
+    COUNTER_EEPROM_USED,       // bytes waiting in the EEPROM after the last write, gauge
+    COUNTER_EEPROM_STALLS,     // times writeData had to wait for a write cycle, every buffered page being full
+    COUNTER_TIMER_CYCLES,      // cycles TC0_Handler started because no sync pulse came in time
+    COUNTER_MISSED_CYCLES,     // cycles that ended before the state machine got to the one before
+    COUNTER_SYNC_PULSES,       // sync pulses (syncHandler)
+    COUNTER_FSM_INTERRUPTS,    // cycles a sync pulse cut short (FSMUpdate's interrupted transitions)
+    COUNTER_FEC_MAX_CYCLES,    // longest Reed-Solomon encode of a frame in MCK cycles, high water mark
+    COUNTER_CODING_MAX_CYCLES, // longest sweepEncode() in MCK cycles, high water mark
+    NUM_COUNTERS
+};
+
+namespace counters {
+    extern volatile uint32_t values[NUM_COUNTERS];
+
+    inline void add(Counter counter, uint32_t n = 1){ values[counter] += n; }
+    inline void set(Counter counter, uint32_t value){ values[counter] = value; }
+    /**
+     * @brief High water mark: keeps the larger of the counter and value.
+     */
+    inline void raise(Counter counter, uint32_t value){ if (value > values[counter]) values[counter] = value; }
+    inline uint32_t get(Counter counter){ return values[counter]; }
+
+#ifndef ARDUINO
+    /**
+     * @brief Column name for the ground side, e.g. "uart_rejected".
+     */
+    const char* name(Counter counter);
+#endif
+}
+#endif
@@ -0,0 +1,35 @@
+/**
+ * @file FSM.hpp
+ * @brief States and entry points of the shield's finite state machine. Implemented in main.cpp.
+ *
+ * Lives in a header so the host simulator (ShieldSim.cpp) can drive and observe the real state machine.
+ */
+#ifndef FSM_HPP
+#define FSM_HPP
+
+//========== Finite State Machine States ==========//
+enum BobState {
+	idle,
+	startSweep,
+	sendSweep,
+	takeIMU,
+	sendIMU,
+	sendStored,
+	sendTimeStamps,
+	waitForNewCycle,
+	interrupted,
+    store,
+    read,
+    NUM_BOB_STATES
+};
+extern BobState currentState;
+
+/**
+ * @brief Finite State Machine update function. Picks the next state.
+ */
+void FSMUpdate();
+/**
+ * @brief Finite State Machine action function. Runs the current state.
+ */
+void FSMAction();
+#endif
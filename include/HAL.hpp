@@ -0,0 +1,327 @@
+/**
+ * @file HAL.hpp
+ * @brief Thin hardware abstraction layer for the shield drivers.
+ *
+ * Pip, Max1148, AT25M02, PDC, the IMU wrapper and main.cpp only talk to the board through the functions in the hal namespace:
+ * the SPI bus, GPIO, the DACs, the clock, the UART and its PDC channel, the TC0 tick timer and the sync interrupt.
+ *
+ * On the Due (ARDUINO is defined by the framework) every function is an inline forward to the Arduino core or the CMSIS
+ * registers, so the firmware compiles to the same code it did before the HAL existed. The few that are more than a
+ * forward (DMA set up) are in HALDue.cpp.
+ *
+ * On a Linux host (the native environment in platformio.ini) the same functions are implemented in HALSim.cpp against
+ * simulated devices and a virtual microsecond clock. See HALSim.hpp for the device models.
+ */
+#ifndef HAL_HPP
+#define HAL_HPP
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#include <SPI.h>
+#include <Wire.h>
+#else
+// Arduino constants used by the drivers and main.cpp. Values match the SAM core where it matters.
+#define LOW 0x0
+#define HIGH 0x1
+#define INPUT 0x0
+#define OUTPUT 0x1
+#define INPUT_PULLUP 0x2
+#define CHANGE 2
+#define FALLING 3
+#define RISING 4
+#define LSBFIRST 0
+#define MSBFIRST 1
+#define SPI_MODE0 0x02
+#define SPI_MODE1 0x00
+#define SPI_MODE2 0x03
+#define SPI_MODE3 0x01
+#define LED_BUILTIN 13
+#define DAC0 66
+#define DAC1 67
+#define UART_IER_TXBUFE (0x1u << 11)
+#define UART_IER_ENDTX (0x1u << 4)
+
+typedef uint8_t byte;
+
+// Interrupt vectors the simulator dispatches to. Weak defaults live in HALSim.cpp, just like the CMSIS vector table.
+// The UART one is not among them: the core's UART_Handler belongs to Serial, see hal::uart_attach_interrupt().
+extern "C" {
+    void TC0_Handler(void);
+    void DMAC_Handler(void);
+}
+#endif
+
+namespace hal {
+#ifdef ARDUINO
+typedef SPISettings SpiSettings;
+typedef Uart UartRegs;
+typedef uint32_t IrqState;
+
+//========== SPI bus ==========//
+inline void spi_begin(){ SPI.begin(); }
+inline void spi_begin_transaction(const SpiSettings& settings){ SPI.beginTransaction(settings); }
+inline uint8_t spi_transfer(uint8_t data){ return SPI.transfer(data); }
+inline void spi_transfer(void* buffer, size_t length){ SPI.transfer(buffer, length); }
+inline void spi_end_transaction(){ SPI.endTransaction(); }
+
+//========== SPI with hardware chip select and DMA ==========//
+/**
+ * @brief Hands pin (10, 4 or 52 - NPCS0..2) to the SPI0 peripheral so it drives chip select itself, configures that
+ * chip select with settings and a frame width of bits (8 to 16), and turns on the DMAC. hal::pin_mode(pin, OUTPUT)
+ * gives the pin back to GPIO.
+ */
+void spi_hw_cs_begin(uint32_t pin, const SpiSettings& settings, uint8_t bits);
+/**
+ * @brief SPI0 transmit word for a hardware chip select transfer. last raises chip select after this frame (LASTXFER).
+ */
+inline uint32_t spi_tdr(uint32_t pin, uint16_t data, bool last){
+    uint32_t word = data | SPI_TDR_PCS(~(1u << BOARD_PIN_TO_SPI_CHANNEL(pin)) & 0xF);
+    return last ? (word | SPI_TDR_LASTXFER) : word;
+}
+/**
+ * @brief Exchanges one spi_tdr() word directly through the SPI0 registers. Returns the received frame.
+ */
+inline uint16_t spi_frame(uint32_t word){
+    while (!(SPI0->SPI_SR & SPI_SR_TDRE)){
+        ;
+    }
+    SPI0->SPI_TDR = word;
+    while (!(SPI0->SPI_SR & SPI_SR_RDRF)){
+        ;
+    }
+    return (uint16_t)SPI0->SPI_RDR;
+}
+/**
+ * @brief Starts a DMAC transfer of count spi_tdr() words to SPI0 while the received frames are stored to rx.
+ * Returns immediately - poll spi_dma_busy(). Both buffers must stay valid until then.
+ */
+void spi_dma_start(const uint32_t* tx, uint16_t* rx, size_t count);
+/**
+ * @brief True until the last frame of the current DMA transfer has been received.
+ */
+bool spi_dma_busy();
+/**
+ * @brief Raises DMAC_Handler once the current DMA transfer has received its last frame. Call after spi_dma_start(),
+ * which turns the interrupt off again, so only the transfers that ask for it interrupt.
+ */
+void spi_dma_notify();
+/**
+ * @brief Turns the completion interrupt off and clears it. Must be called from DMAC_Handler.
+ */
+void spi_dma_ack();
+
+//========== GPIO ==========//
+inline void pin_mode(uint32_t pin, uint32_t mode){ pinMode(pin, mode); }
+inline void digital_write(uint32_t pin, uint32_t value){ digitalWrite(pin, value); }
+inline int digital_read(uint32_t pin){ return digitalRead(pin); }
+
+//========== DAC ==========//
+inline void dac_resolution(int bits){ analogWriteResolution(bits); }
+inline void dac_write(uint32_t pin, uint32_t value){ analogWrite(pin, value); }
+
+//========== Clock ==========//
+inline uint32_t micros(){ return ::micros(); }
+inline void delay_us(uint32_t us){ delayMicroseconds(us); }
+inline void delay_ms(uint32_t ms){ delay(ms); }
+/**
+ * @brief Starts the Cortex-M3 cycle counter (DWT CYCCNT), for timing code in MCK cycles.
+ */
+inline void cycle_counter_begin(){
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+inline uint32_t cycle_count(){ return DWT->CYCCNT; }
+
+//========== UART and its PDC channel ==========//
+inline void uart_begin(uint32_t baud){ Serial.begin(baud); }
+inline UartRegs* uart_regs(){ return UART; }
+inline void uart_irq_enable(){ NVIC_EnableIRQ(UART_IRQn); }
+inline void uart_irq_disable(){ NVIC_DisableIRQ(UART_IRQn); }
+/**
+ * @brief Sends the UART interrupt to handler. The core already defines UART_Handler (variant.cpp, for Serial's receive
+ * buffer), so the firmware cannot: the first call moves the vector table to SRAM and the UART vector is changed there.
+ * Call before hal::uart_irq_enable().
+ */
+void uart_attach_interrupt(void (*handler)());
+
+//========== I2C (IMU) ==========//
+inline void i2c_begin(){ Wire.begin(); }
+
+//========== Interrupts ==========//
+/**
+ * @brief Saves PRIMASK and disables interrupts. Pass the result to irq_restore().
+ */
+inline IrqState irq_save(){
+    IrqState state = __get_PRIMASK();
+    __disable_irq();
+    return state;
+}
+inline void irq_restore(IrqState state){ __set_PRIMASK(state); }
+inline void attach_interrupt(uint32_t pin, void (*handler)(), uint32_t mode){
+    attachInterrupt(digitalPinToInterrupt(pin), handler, mode);
+}
+
+/**
+ * @brief Starts TC0 channel 0 as the periodic tick that calls TC0_Handler.
+ * - WAVE + WAVSEL_UP_RC puts it in RC compare waveform mode, so the counter resets when it reaches RC.
+ * - TIMER_CLOCK4 is MCK/128. MCK is 84 MHz, so the counter runs at 656.25 kHz.
+ * Documentation for internal functions - see tc.c (system/libsam/source/tc.c at https://github.com/swallace23/framework-arduino-sam)
+ * @param rc - compare value. Interrupt frequency = 656.25 kHz / (rc+1).
+ */
+inline void tick_timer_begin(uint32_t rc){
+    pmc_enable_periph_clk(ID_TC0);
+    TC_Configure(TC0, 0, TC_CMR_WAVE | TC_CMR_WAVSEL_UP_RC | TC_CMR_TCCLKS_TIMER_CLOCK4);
+    TC_SetRC(TC0, 0, rc);
+    // Enable the RC compare interrupt, disable all other TC0 interrupts
+    TC0->TC_CHANNEL[0].TC_IER = TC_IER_CPCS;
+    TC0->TC_CHANNEL[0].TC_IDR = ~TC_IER_CPCS;
+    NVIC_EnableIRQ(TC0_IRQn);
+    NVIC_SetPriority(TC0_IRQn, 0);
+    TC_Start(TC0, 0);
+}
+/**
+ * @brief Clears the TC0 status register. Must be called from TC0_Handler, otherwise the interrupt fires repeatedly.
+ */
+inline void tick_timer_ack(){ TC_GetStatus(TC0, 0); }
+
+//========== Timer triggered DAC sweep ==========//
+/**
+ * @brief Starts a DACC sweep that runs without the CPU. The PDC feeds count dac_sweep_word() words to the DACC in
+ * tagged word mode, and TC0 channel 1 (TIOA1) triggers one conversion every trigger_ticks. Half-word j (channel 0 then
+ * channel 1 of each word) is converted at (j + 1/2) * trigger_ticks. TC0 channel 2 counts the same ticks from the start,
+ * see dac_sweep_ticks(). TC0 channel 0 (the tick timer) is left alone.
+ * @param trigger_ticks - in DAC_SWEEP_TICKS_PER_US units (TIMER_CLOCK1, MCK/2)
+ */
+void dac_sweep_start(const uint32_t* words, size_t count, uint32_t trigger_ticks);
+/**
+ * @brief Ticks since dac_sweep_start().
+ */
+inline uint32_t dac_sweep_ticks(){ return TC0->TC_CHANNEL[2].TC_CV; }
+/**
+ * @brief Spins until dac_sweep_ticks() reaches ticks.
+ */
+inline void dac_sweep_wait(uint32_t ticks){
+    while (TC0->TC_CHANNEL[2].TC_CV < ticks){
+        ;
+    }
+}
+/**
+ * @brief Stops the timers and the PDC and puts the DACC back in free running mode, so dac_write() works again.
+ */
+void dac_sweep_stop();
+
+#else
+/**
+ * @brief Host stand-in for Arduino's SPISettings. Only the clock is used by the simulator (it sets the byte time).
+ */
+struct SpiSettings {
+    uint32_t clock;
+    uint8_t bit_order;
+    uint8_t mode;
+    SpiSettings() : clock(4000000), bit_order(MSBFIRST), mode(SPI_MODE0) {}
+    SpiSettings(uint32_t clock, uint8_t bit_order, uint8_t mode) : clock(clock), bit_order(bit_order), mode(mode) {}
+};
+
+/**
+ * @brief One simulated UART register. Reads and writes go through the simulator so that the PDC
+ * drains in virtual time and status bits are current, like the real peripheral.
+ */
+class UartReg {
+public:
+    explicit UartReg(int index) : index(index), value(0) {}
+    operator uintptr_t() const;
+    UartReg& operator=(uintptr_t v);
+    UartReg& operator|=(uintptr_t v){ return *this = (uintptr_t)*this | v; }
+    const int index;
+    uintptr_t value;
+private:
+    UartReg(const UartReg&);
+};
+
+/**
+ * @brief Host stand-in for the CMSIS Uart register block. Same field names, so drivers can use either.
+ * Pointer registers are uintptr_t wide so that host pointers fit.
+ */
+struct UartRegs {
+    enum { CR, MR, IER, IDR, IMR, SR, RHR, THR, BRGR, TPR, TCR, TNPR, TNCR, PTCR, PTSR, COUNT };
+    UartReg UART_CR{CR};
+    UartReg UART_MR{MR};
+    UartReg UART_IER{IER};
+    UartReg UART_IDR{IDR};
+    UartReg UART_IMR{IMR};
+    UartReg UART_SR{SR};
+    UartReg UART_RHR{RHR};
+    UartReg UART_THR{THR};
+    UartReg UART_BRGR{BRGR};
+    UartReg UART_TPR{TPR};
+    UartReg UART_TCR{TCR};
+    UartReg UART_TNPR{TNPR};
+    UartReg UART_TNCR{TNCR};
+    UartReg UART_PTCR{PTCR};
+    UartReg UART_PTSR{PTSR};
+};
+
+typedef bool IrqState;
+
+void spi_begin();
+void spi_begin_transaction(const SpiSettings& settings);
+uint8_t spi_transfer(uint8_t data);
+void spi_transfer(void* buffer, size_t length);
+void spi_end_transaction();
+
+void spi_hw_cs_begin(uint32_t pin, const SpiSettings& settings, uint8_t bits);
+uint32_t spi_tdr(uint32_t pin, uint16_t data, bool last);
+uint16_t spi_frame(uint32_t word);
+void spi_dma_start(const uint32_t* tx, uint16_t* rx, size_t count);
+bool spi_dma_busy();
+void spi_dma_notify();
+void spi_dma_ack();
+
+void pin_mode(uint32_t pin, uint32_t mode);
+void digital_write(uint32_t pin, uint32_t value);
+int digital_read(uint32_t pin);
+
+void dac_resolution(int bits);
+void dac_write(uint32_t pin, uint32_t value);
+
+uint32_t micros();
+void delay_us(uint32_t us);
+void delay_ms(uint32_t ms);
+void cycle_counter_begin();
+uint32_t cycle_count();
+
+void uart_begin(uint32_t baud);
+UartRegs* uart_regs();
+void uart_irq_enable();
+void uart_irq_disable();
+void uart_attach_interrupt(void (*handler)());
+
+void i2c_begin();
+
+IrqState irq_save();
+void irq_restore(IrqState state);
+void attach_interrupt(uint32_t pin, void (*handler)(), uint32_t mode);
+
+void tick_timer_begin(uint32_t rc);
+void tick_timer_ack();
+
+void dac_sweep_start(const uint32_t* words, size_t count, uint32_t trigger_ticks);
+uint32_t dac_sweep_ticks();
+void dac_sweep_wait(uint32_t ticks);
+void dac_sweep_stop();
+#endif
+
+// TC0 TIMER_CLOCK1 is MCK/2 = 42 MHz
+#define DAC_SWEEP_TICKS_PER_US 42
+/**
+ * @brief One dac_sweep_start() table word: channel 0 and channel 1 codes, tagged with their channel numbers.
+ */
+inline uint32_t dac_sweep_word(uint16_t ch0, uint16_t ch1){
+    return (uint32_t)(ch0 & 0x0FFF) | ((uint32_t)((ch1 & 0x0FFF) | (1u << 12)) << 16);
+}
+}
+#endif
@@ -0,0 +1,212 @@
+/**
+ * @file HALSim.hpp
+ * @brief Simulated shield used by the host build of the HAL.
+ *
+ * Only compiled when ARDUINO is not defined (the native environment in platformio.ini).
+ * Everything here runs on a virtual clock in nanoseconds. HAL calls charge the time the same call takes on the Due
+ * (SPI bytes at the configured clock, UART bytes at the configured baud, rough costs for digitalWrite/analogWrite),
+ * so the virtual micros() seen by the drivers and main.cpp behaves like the board.
+ *
+ * The default wiring mirrors the shield: the Max1148 model sits on ADC_CS_PIN (10) with CHAN2 watching DAC0 and CHAN1
+ * watching DAC1, and the AT25M02 model sits on pin 4. Pure computation is free in virtual time - use the wall clock to
+ * benchmark that part.
+ */
+#ifndef HAL_SIM_HPP
+#define HAL_SIM_HPP
+#ifndef ARDUINO
+#include <HAL.hpp>
+#include <vector>
+
+// Rough costs of HAL calls on the Due, charged to the virtual clock. In nanoseconds.
+#define SIM_DIGITAL_WRITE_NS 700
+#define SIM_DAC_WRITE_NS 3000
+#define SIM_SPI_BYTE_OVERHEAD_NS 300
+#define SIM_MICROS_NS 250
+#define SIM_I2C_BYTE_NS 90000
+// One pass of loop() (FSMUpdate + FSMAction dispatch) when it makes no HAL calls of its own
+#define SIM_LOOP_NS 500
+// SPI0 delay between consecutive transfers, DLYBCT(1) = 32 MCK cycles. Only hardware chip select transfers pay it.
+#define SIM_SPI_DLYBCT_NS 381
+// Writing TDR and polling TDRE/RDRF for one hal::spi_frame(), about 10 MCK cycles
+#define SIM_SPI_FRAME_OVERHEAD_NS 120
+// Master clock, for hal::cycle_count()
+#define SIM_MCK_HZ 84000000ULL
+// AT25M02 self-timed write cycle
+#define SIM_EEPROM_WRITE_CYCLE_NS 5000000ULL
+#define SIM_EEPROM_SIZE (1UL << 18)
+#define SIM_EEPROM_PAGE_LEN 256
+
+namespace hal {
+namespace sim {
+    /**
+     * @brief Current virtual time in nanoseconds.
+     */
+    uint64_t now_ns();
+    /**
+     * @brief Moves virtual time forward, draining the UART PDC and firing any interrupt that comes due on the way.
+     */
+    void advance_ns(uint64_t ns);
+
+    typedef void (*EventFn)(void* context);
+    /**
+     * @brief Schedules fn(context) at an absolute virtual time. Events run outside interrupt context, like hardware
+     * outside the CPU (a sync pulse arriving, a test fixture changing a pin), and may schedule further events.
+     */
+    void schedule(uint64_t at_ns, EventFn fn, void* context);
+    /**
+     * @brief Time of the next thing that can change firmware state: a scheduled event, a TC0 tick or a UART byte.
+     * Returns UINT64_MAX when nothing is pending.
+     */
+    uint64_t next_event_ns();
+    /**
+     * @brief Jumps virtual time to next_event_ns(). Use when the firmware is spinning on flags only an interrupt can set.
+     */
+    void skip_to_next_event();
+    /**
+     * @brief Drives a pin low. If a handler is attached with FALLING or CHANGE it runs as soon as interrupts allow.
+     */
+    void pin_falling_edge(uint32_t pin);
+
+    /**
+     * @brief A device on the shared SPI bus. exchange() is called once per byte while the device's chip select is low.
+     */
+    class SpiDevice {
+    public:
+        virtual ~SpiDevice() {}
+        virtual void select() {}
+        virtual void deselect() {}
+        virtual uint8_t exchange(uint8_t mosi) = 0;
+    };
+    /**
+     * @brief Puts a device on the SPI bus behind the given chip select pin. Pass nullptr to remove it.
+     */
+    void attach_spi_device(uint32_t cs_pin, SpiDevice* device);
+
+    /**
+     * @brief One byte on the SPI bus.
+     */
+    struct SpiTraceEntry {
+        uint32_t cs_pin;
+        uint8_t mosi;
+        uint8_t miso;
+        // First byte since chip select went low
+        bool frame_start;
+    };
+    /**
+     * @brief Starts (and clears) or stops recording every byte on the bus, polled or DMA.
+     */
+    void spi_trace_enable(bool enable);
+    std::vector<SpiTraceEntry>& spi_trace();
+
+    /**
+     * @brief Byte level model of the Max1148 in external clock mode.
+     * A byte with the START bit (MSB) set is a control byte. The 16-bit result of that conversion comes out on the next
+     * two bytes, so a control byte may be clocked in while the previous result is still being clocked out.
+     * Results are 14-bit, left justified.
+     */
+    class Max1148Model : public SpiDevice {
+    public:
+        Max1148Model();
+        void deselect();
+        uint8_t exchange(uint8_t mosi);
+        /**
+         * @brief Makes the given ADC channel read the voltage on a DAC pin through the probe response.
+         */
+        void wire(int channel, uint32_t dac_pin);
+        /**
+         * @brief Decodes the channel from a control byte (SEL2..SEL0 are bits 6..4).
+         */
+        static int channel_of(uint8_t control);
+        /**
+         * @brief 14-bit conversion result for a channel. Default is a smooth Langmuir-like I-V curve plus a little noise.
+         */
+        virtual uint16_t sample(int channel);
+        /**
+         * @brief Restarts the noise sequence, so two runs see the same samples.
+         */
+        void seed(uint32_t seed);
+        uint64_t conversions;
+    private:
+        int32_t dac_of_channel[8];
+        uint8_t out[2];
+        uint8_t out_len;
+        uint32_t noise;
+    };
+
+    /**
+     * @brief Model of the AT25M02 EEPROM: 256 KiB, 256 byte pages, WEL, self-timed write cycle and 18-bit addressing.
+     */
+    class AT25M02Model : public SpiDevice {
+    public:
+        AT25M02Model();
+        void select();
+        void deselect();
+        uint8_t exchange(uint8_t mosi);
+        bool busy() const;
+        std::vector<uint8_t> memory;
+        uint8_t status;
+        uint64_t busy_until_ns;
+        uint64_t page_writes;
+        uint64_t status_polls;
+        uint64_t bytes_read;
+        uint64_t rejected_while_busy;
+        uint64_t writes_without_wel;
+        uint64_t reads_wrapped;     // READs that ran off the end of the array and rolled over to 0
+        uint64_t page_rollovers;    // page programs that ran off the end of their page and wrapped inside it
+    private:
+        uint8_t opcode;
+        int byte_index;
+        uint32_t address;
+        uint32_t data_bytes;
+        uint8_t page[SIM_EEPROM_PAGE_LEN];
+        uint8_t new_status;
+    };
+
+    Max1148Model& adc();
+    AT25M02Model& eeprom();
+    /**
+     * @brief Last value written to a DAC pin.
+     */
+    uint32_t dac_value(uint32_t pin);
+    int pin_state(uint32_t pin);
+
+    /**
+     * @brief Bytes shifted out of the UART since start up.
+     */
+    uint64_t uart_bytes_sent();
+    /**
+     * @brief Every byte the UART has sent, if capture is enabled (it is by default).
+     */
+    std::vector<uint8_t>& uart_capture();
+    void uart_capture_enable(bool enable);
+}
+}
+
+/**
+ * @brief Host stand-in for the Pololu LIS3MDL library. Same register names, reads a spinning payload's field.
+ */
+class LIS3MDL {
+public:
+    template <typename T> struct vector { T x, y, z; };
+    enum regAddr { CTRL_REG1 = 0x20, CTRL_REG2 = 0x21, CTRL_REG3 = 0x22, CTRL_REG4 = 0x23, CTRL_REG5 = 0x24 };
+    vector<int16_t> m;
+    bool init(){ return true; }
+    void writeReg(uint8_t reg, uint8_t value);
+    void read();
+};
+
+/**
+ * @brief Host stand-in for the Pololu LSM6 library.
+ */
+class LSM6 {
+public:
+    template <typename T> struct vector { T x, y, z; };
+    enum regAddr { CTRL1_XL = 0x10, CTRL2_G = 0x11, CTRL9_XL = 0x18, CTRL10_C = 0x19 };
+    vector<int16_t> a;
+    vector<int16_t> g;
+    bool init(){ return true; }
+    void writeReg(uint8_t reg, uint8_t value);
+    void read();
+};
+#endif
+#endif
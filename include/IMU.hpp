@@ -13,10 +13,16 @@
 
 #ifndef IMU_HPP
 #define IMU_HPP
-#include <Arduino.h>
-#include <Wire.h>
+#include <HAL.hpp>
+#ifdef ARDUINO
 #include <LIS3MDL.h>
 #include <LSM6.h>
+#else
+#include <HALSim.hpp> // stand-ins for the Pololu libraries
+#endif
+
+#define IMU_VALUES 10   // int16 values in an IMU record. sampleIMU() fills the first 9, magnetometer, accelerometer, gyro
+
 /**
  * @brief Initializes the IMU. Sets settings for all used axes.
  * 
@@ -26,8 +26,7 @@ There are two SPI boxes. Use one for the memory and one for the ADC. Arduino sho
 */
 #ifndef MAX1148_HPP
 #define MAX1148_HPP
-#include <Arduino.h>
-#include <SPI.h>
+#include <HAL.hpp>
 
 #define SPI_SPEED 2000000
 #define SPI_MODE SPI_MODE0
@@ -35,6 +34,20 @@ There are two SPI boxes. Use one for the memory and one for the ADC. Arduino sho
 #define ADC_PIN 10
 #define ADC_CS_PIN 10
 #define ADC_READ 0x00
+// Most SPI frames one conversion takes in a DMA transfer (8-bit frames: control byte, then two to clock out the result)
+#define MAX1148_DMA_WORDS 3
+
+/**
+ * @brief How a Max1148 reaches the ADC.
+ * GPIO_CS - 8-bit SPI.transfer calls, chip select driven with digitalWrite around each conversion.
+ * HW_CS16 - the SPI peripheral drives chip select (NPCS) itself and frames are 16 bits. Each frame carries a zero byte
+ * and a control byte, and the Max1148 ignores the zeros before a START bit. A frame returns the full result of the
+ * conversion started by the previous frame, so a pipelined conversion is one register exchange and a single one is two.
+ */
+enum class AdcTransport : uint8_t{
+    GPIO_CS,
+    HW_CS16
+};
 
 /**
  * @brief Control bytes for the Max1148 ADC.
@@ -58,7 +71,8 @@ class Max1148{
     /**
      * @brief ADC functions should really only be used in relation to Pip measurements, so everything is private and Pip is a friend.
      */
-    friend class Pip;
+    template <uint16_t Steps, uint16_t Averages> friend class Pip;
+    template <uint16_t Steps, uint16_t Averages, uint8_t Probes> friend class PipController;
     private:
         /**
          * @brief Chip select pin for the ADC.
@@ -86,15 +100,64 @@ class Max1148{
          * @brief Reads a single ADC value from the Max1148 ADC. Used in adc_read_avg.
          */
         uint16_t adc_read();
+        /**
+         * @brief Starts a run of pipelined conversions (16 clocks each instead of 24): chip select low, then this
+         * channel's control byte. Follow with pipeline_read().
+         */
+        void pipeline_start();
+        /**
+         * @brief Clocks out the result of the conversion in progress. The next control byte goes out with the second
+         * result byte, so the next conversion starts right away.
+         * @param next - ADC (channel) to convert next. nullptr ends the run and raises chip select.
+         */
+        uint16_t pipeline_read(const Max1148* next);
+        /**
+         * @brief How this ADC is reached. See set_transport().
+         */
+        AdcTransport transport;
+        /**
+         * @brief Hands chip select to the SPI peripheral for DMA (hardware true), or back to GPIO. Nothing to do when
+         * the transport already uses hardware chip select.
+         */
+        void claim_cs(bool hardware);
+        /**
+         * @brief Writes the hal::spi_tdr() words of one conversion to words, for a DMA transfer with hardware chip
+         * select. Same bytes as adc_read(), chip select rises after the last one.
+         * @return number of words written, at most MAX1148_DMA_WORDS. Also the stride of the results in the received frames.
+         */
+        int dma_words(uint32_t* words) const;
+        /**
+         * @brief First word of a pipelined DMA run - this channel's control byte.
+         */
+        uint32_t dma_start_word() const;
+        /**
+         * @brief Writes the words that clock out this conversion and start next's, same bytes as pipeline_read(next).
+         * @return number of words written. Results are read with dma_result() at this stride, starting from the
+         * dma_start_word() frame.
+         */
+        int dma_words_next(uint32_t* words, const Max1148* next) const;
+        /**
+         * @brief Result of one conversion from the frames received for dma_words() or dma_words_next(). Same value adc_read() returns.
+         */
+        uint16_t dma_result(const uint16_t* rx) const {
+            if (transport == AdcTransport::HW_CS16) return rx[1];
+            return (uint16_t)(((rx[1] & 0xFF) << 8) | (rx[2] & 0xFF));
+        }
     public:
         /**
          * @brief ADC constructor. Sets cs_pin as per ADC_CS_PIN macro. Chooses channel from Channel enum.
          * @param channel The channel to read from. Format: CHAN0, CHAN1, etc. I don't remember why it has to be static_cast but it works.
          */
-        Max1148(Channel channel): cs_pin(ADC_CS_PIN) {
+        Max1148(Channel channel): cs_pin(ADC_CS_PIN), transport(AdcTransport::GPIO_CS) {
             this->channel = static_cast<uint8_t>(channel);
-            pinMode(cs_pin, OUTPUT);
-        }        
+            hal::pin_mode(cs_pin, OUTPUT);
+        }
+        /**
+         * @brief Selects how conversions reach the ADC. Call after hal::spi_begin(). Every Max1148 on ADC_CS_PIN shares
+         * the chip select, so they should all use the same transport.
+         */
+        void set_transport(AdcTransport t);
+        AdcTransport get_transport() const { return transport; }
 };        
 
 
@@ -13,72 +13,162 @@
 
 #ifndef PDC_HPP
 #define PDC_HPP
-#include <Arduino.h>
-
-// Defining relevant UART registers
-#define UART_BASE 0x400E0800
-#define UART_PERIPH_TPR_ADDR (UART_BASE + 0x108) // Transmit pointer register
-#define UART_PERIPH_TCR_ADDR (UART_BASE + 0x10C) // Transmit counter register
-#define UART_PERIPH_TNPR_ADDR (UART_BASE + 0x118) // Transmit next pointer register
-#define UART_PERIPH_TNCR_ADDR (UART_BASE + 0x11C) // Transmit next counter register
-#define UART_PERIPH_PTCR_ADDR (UART_BASE + 0x120) // Peripheral transfer control register
-#define UART_PERIPH_PTSR_ADDR (UART_BASE + 0x124) // Peripheral transfer status register
-#define UART_SR (UART_BASE + 0x0014) // Status register
+#include <HAL.hpp>
+#include <Counters.hpp>
 
 #define TXTEN (1<<8) //mask used to enable UART transmitter
 #define TXBUFE (1<<11) //check if UART is ready
+#define ENDTX (1<<4) //PDC transmit counter reached zero
+// Segments that can wait for the UART, including the two loaded in the PDC. Power of two.
+#define PDC_TX_QUEUE_LEN 128
+
+/**
+ * @brief One piece of a frame: a buffer the UART sends straight from. The data is not copied - it has to stay put until
+ * it is sent, see is_queued().
+ */
+struct TxSegment {
+    const void* data;
+    uint16_t length;
+};
+
 /**
  * @brief Manages UART transmits through peripheral DMA controller (PDC).
+ *
+ * A frame is a list of TxSegments - sentinel, timestamp, data, each sent from where it lives - and goes into a ring of
+ * segment descriptors. The PDC has a current (TPR/TCR) and a next (TNPR/TNCR) pointer/counter pair, and when the current
+ * one runs out it reloads from the next one and sets ENDTX. UART_Handler() runs on ENDTX and loads the next segment from
+ * the ring into TNPR/TNCR, so segments and frames go out back to back, without a gap, a packing copy or the CPU waiting.
+ * main.cpp's uartHandler, attached with hal::uart_attach_interrupt(), must call it.
+ *
+ * Ring positions are free running counters, the slot is the counter modulo PDC_TX_QUEUE_LEN:
+ * head - oldest segment not sent yet, loaded - next segment to hand to the PDC, tail - next free slot.
  */
 class PDC {
 private:
-    // pointers to UART registers
-    volatile uint32_t* const p_UART_TPR;
-    volatile uint32_t* const p_UART_TCR;
-    volatile uint32_t* const p_UART_TNPR;
-    volatile uint32_t* const p_UART_TNCR;
-    volatile uint32_t* const p_UART_PTCR;
-    volatile uint32_t* const p_UART_PTSR;
-    volatile uint32_t* const p_UART_SR;
-
-    uint8_t backup_buffer[294];
+    // UART register block, including the PDC transmit registers. Comes from the HAL so the host build can simulate it.
+    hal::UartRegs* const uart;
 
+    /**
+     * @brief A queued segment. frame_end marks the last one of a frame, for the frame counters.
+     */
+    struct QueuedSegment {
+        const uint8_t* data;
+        uint16_t length;
+        bool frame_end;
+    };
+    QueuedSegment queue[PDC_TX_QUEUE_LEN];
+    volatile uint32_t head;
+    volatile uint32_t loaded;
+    volatile uint32_t tail;
 
-    
+    /**
+     * @brief Moves head past the frames the PDC has finished. Whatever was loaded and is no longer in TPR/TNPR is sent.
+     * Interrupts must be off.
+     */
+    void retire(){
+        uint32_t in_pdc = (uart->UART_TCR != 0) + (uart->UART_TNCR != 0);
+        uint32_t done = (loaded - head) - in_pdc;
+        for (; done > 0; done--, head++){
+            if (queue[head % PDC_TX_QUEUE_LEN].frame_end) counters::add(COUNTER_UART_SENT);
+        }
+    }
+    /**
+     * @brief Hands queued frames to whichever of the two PDC pointer/counter pairs is free. ENDTX interrupts stay on
+     * while frames are waiting for a pair, then TXBUFE until the PDC has sent the last of them, so they are retired
+     * as soon as they are out and not at the next call. Interrupts must be off.
+     */
+    void fill(){
+        retire();
+        while (loaded != tail){
+            const QueuedSegment& segment = queue[loaded % PDC_TX_QUEUE_LEN];
+            if (uart->UART_TCR == 0){
+                uart->UART_TPR = (uintptr_t)segment.data;
+                uart->UART_TCR = segment.length;
+            } else if (uart->UART_TNCR == 0){
+                uart->UART_TNPR = (uintptr_t)segment.data;
+                uart->UART_TNCR = segment.length;
+            } else {
+                break;
+            }
+            loaded++;
+        }
+        if (loaded != tail){
+            uart->UART_IDR = TXBUFE;
+            uart->UART_IER = ENDTX;
+        } else if (head != tail){
+            uart->UART_IDR = ENDTX;
+            uart->UART_IER = TXBUFE;
+        } else {
+            uart->UART_IDR = ENDTX | TXBUFE;
+        }
+    }
 
 public:
     /**
-     * @brief Default constructor for the PDC class. Initializes all relevant register pointers
+     * @brief Default constructor for the PDC class. Points at the UART register block.
      */
     PDC()
-        : p_UART_TPR((uint32_t*)UART_PERIPH_TPR_ADDR),
-          p_UART_TCR((uint32_t*)UART_PERIPH_TCR_ADDR),
-          p_UART_TNPR((uint32_t*)UART_PERIPH_TNPR_ADDR),
-          p_UART_TNCR((uint32_t*)UART_PERIPH_TNCR_ADDR),
-          p_UART_PTCR((uint32_t*)UART_PERIPH_PTCR_ADDR),
-          p_UART_PTSR((uint32_t*)UART_PERIPH_PTSR_ADDR),
-          p_UART_SR((uint32_t*)UART_SR)
+        : uart(hal::uart_regs()), head(0), loaded(0), tail(0)
     {}
 
 
     /**
      * @brief Turns on PDC, waits until ready. Must be called AFTER Serial.begin() in setup().
+     * Nothing reads the UART, so its receive interrupts are turned off and the interrupt is left to UART_Handler().
+     * The handler that calls it must already be attached.
      */
     void init(){
     //enable pdc transmitter
-    *p_UART_PTCR |= TXTEN;
+    uart->UART_PTCR = TXTEN;
     //wait until ready
     while(! PDC::is_on()){
         ;
     }
-
+    uart->UART_IDR = 0xFFFFFFFF;
+    hal::uart_irq_enable();
     }
     /**
-     * @brief Adds data to the PDC buffer to be sent out through UART.
+     * @brief Queues a frame made of count segments, sent one after the other with no gap. Returns straight away - the
+     * PDC sends it after any frames already waiting. The whole frame is queued or none of it.
+     * @param segments - the frame's pieces. The list itself is copied, the data they point at is not: it must stay put
+     * until sent - globals, not written again while is_queued().
+     * Counts the frame, its bytes and the ring's high water mark, or the drop, in the housekeeping counters.
+     * @return false if the ring did not have room and the frame was dropped (COUNTER_UART_REJECTED).
+     */
+    bool send_gather(const TxSegment* segments, int count){
+        hal::IrqState irq_state = hal::irq_save();
+        retire();
+        if (tail - head + count > PDC_TX_QUEUE_LEN){
+            counters::add(COUNTER_UART_REJECTED);
+            hal::irq_restore(irq_state);
+            return false;
+        }
+        int last = -1;
+        uint32_t bytes = 0;
+        for (int i = 0; i < count; i++){
+            if (segments[i].length == 0) continue;
+            bytes += segments[i].length;
+            QueuedSegment& segment = queue[tail % PDC_TX_QUEUE_LEN];
+            segment.data = (const uint8_t*)segments[i].data;
+            segment.length = segments[i].length;
+            segment.frame_end = false;
+            last = tail % PDC_TX_QUEUE_LEN;
+            tail++;
+        }
+        if (last >= 0) queue[last].frame_end = true;
+        counters::add(COUNTER_UART_FRAMES);
+        counters::add(COUNTER_UART_BYTES, bytes);
+        counters::raise(COUNTER_PDC_MAX_DEPTH, tail - head);
+        fill();
+        hal::irq_restore(irq_state);
+        return true;
+    }
+    /**
+     * @brief Queues data to be sent out through UART, as a frame of one segment. See send_gather().
      * 
      * 
      * @tparam T - data type of buffer - either char pointer or integer array
-     * @param buffer - pointer to data buffer. Note that it doesn't like pointer casts, so global pointers to sentinels must be used.
+     * @param buffer - pointer to data buffer. It is sent from where it is, so it must stay put until sent.
      * That's not an issue with Arduino's Serial library because it's blocking - avoiding that is the whole point of this.
      * @param size - size of buffer
      * 
@@ -90,73 +180,68 @@ public:
      * @endcode
      * But, Serial.print() is recommended for any debugging application to avoid global declarations.
      * 
-     * Note for later - negative numbers are sent as two's complement. make sure Jules' parser is reading that correctly.
+     * Note for later - negative numbers are sent as two's complement. TelemetryDecoder reads the IMU values as int16, any
+     * other parser has to as well.
      */
     template <typename T>
-    void send(T* buffer, int size){
-        //check if UART is ready for transmit
-        if(*p_UART_SR & TXBUFE){
-                //set buffer and size
-                *(volatile uint32_t*)p_UART_TPR = (uint32_t)buffer;
-                *p_UART_TCR = size;
-           
-        } else{
-            memcpy(backup_buffer, buffer, size);
-            enableUARTInterrupt();
-            /* //wait until ready
-            //digitalWrite(7, HIGH);
-            while(!(*p_UART_SR & TXBUFE)){
-                ;
-            }
-            //digitalWrite(7, LOW);
-            //same as above
-                *(volatile uint32_t*)p_UART_TPR = (uint32_t)buffer;
-                *p_UART_TCR = size; */
+    bool send(T* buffer, int size){
+        TxSegment segment = { buffer, (uint16_t)size };
+        return send_gather(&segment, 1);
+    }
+    /**
+     * @brief True while a queued segment (waiting or being sent) points into the size bytes at buffer, so they must not
+     * be written to yet.
+     */
+    bool is_queued(const void* buffer, size_t size){
+        const uint8_t* start = (const uint8_t*)buffer;
+        hal::IrqState irq_state = hal::irq_save();
+        retire();
+        bool queued = false;
+        for (uint32_t i = head; i != tail; i++){
+            const QueuedSegment& segment = queue[i % PDC_TX_QUEUE_LEN];
+            if (segment.data < start + size && start < segment.data + segment.length) queued = true;
         }
-        
+        hal::irq_restore(irq_state);
+        return queued;
     }
     /**
-     * @brief Adds data to the backup PDC buffer. Identical to send().
+     * @brief Segments waiting or being sent.
      */
-    template <typename T>
-    void send_next(T* buffer, int size){
-                //set buffer and size
-            if(*p_UART_SR & TXBUFE){
-                send(buffer, size);
-            } else if (*p_UART_TNCR==0){
-                *(volatile uint32_t*)p_UART_TNPR = (uint32_t)buffer;
-                *p_UART_TNCR = size;
-            }
-           
-            else if (!(*p_UART_SR & TXBUFE)&&(*p_UART_TNCR!=1)){
-                while(*p_UART_TNCR!=0){
-                    ;
-                }
-                *(volatile uint32_t*)p_UART_TNPR = (uint32_t)buffer;
-                *p_UART_TNCR = size;
-            } else{
-                send(buffer, size);
-            }
-        
+    uint32_t depth(){
+        hal::IrqState irq_state = hal::irq_save();
+        retire();
+        uint32_t d = tail - head;
+        hal::irq_restore(irq_state);
+        return d;
+    }
+    /**
+     * @brief Bytes waiting or being sent: what the PDC has left of its two loaded segments and the queued ones.
+     */
+    uint32_t pending_bytes(){
+        hal::IrqState irq_state = hal::irq_save();
+        retire();
+        uint32_t bytes = uart->UART_TCR + uart->UART_TNCR;
+        for (uint32_t i = loaded; i != tail; i++){
+            bytes += queue[i % PDC_TX_QUEUE_LEN].length;
+        }
+        hal::irq_restore(irq_state);
+        return bytes;
     }
     /**
      * @brief Checks if the PDC and UART are on.
      */
     bool is_on(){
-        return (*p_UART_PTSR & (1<<8));
-    }
-
-    void enableUARTInterrupt(){
-        //enable UART interrupt
-        NVIC_EnableIRQ(UART_IRQn);
-        //interrupt on TXBUFE
-        UART->UART_IER = UART_IER_TXBUFE;
-        UART->UART_IDR = ~UART_IER_TXBUFE;
+        return (uart->UART_PTSR & (1<<8));
     }
 
+    /**
+     * @brief ENDTX interrupt: the PDC moved on to its next pointer/counter pair, so load the next queued frame into it.
+     * TXBUFE interrupt: the PDC has sent everything, so retire it.
+     * Call from the handler attached to the UART interrupt.
+     */
     void UART_Handler(){
-        send(backup_buffer, sizeof(backup_buffer));
-        NVIC_DisableIRQ(UART_IRQn);
+        if (!(uart->UART_SR & uart->UART_IMR & (ENDTX | TXBUFE))) return;
+        fill();
     }
 };
-#endif
\ No newline at end of file
+#endif
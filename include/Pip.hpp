@@ -13,9 +13,9 @@
  */
 #ifndef PIP_HPP
 #define PIP_HPP
-#include <Arduino.h>
-#include <Wire.h>
+#include <HAL.hpp>
 #include <Max1148.hpp>
+#include <SweepTable.hpp>
 //default sweep parameters. can be modified with the constructor.
 #define SWEEP_DEFAULT_DELAY	1000
 #define SWEEP_DEFAULT_AVG_NUM 25
@@ -29,9 +29,14 @@
 
 /**
  * @brief Manages the Pip sensor sweep and associated data.
+ * @tparam Steps - number of steps in the sweep. Sizes the data array.
+ * @tparam Averages - ADC samples averaged per step. A power of two averages with a shift.
  */
+template <uint16_t Steps, uint16_t Averages>
 class Pip{
-    friend class PipController;
+    template <uint16_t S, uint16_t A, uint8_t P> friend class PipController;
+    static_assert(Steps >= 2 && Steps <= SWEEP_MAX_SAMPLES, "Steps out of range");
+    static_assert(Averages >= 1, "need at least one sample per step");
     private:
         /**
          * @brief The pin for the DAC output.
@@ -47,38 +52,48 @@ class Pip{
          */
         Max1148 &adc;
         /**
-         * @brief The number of samples to average when querying the ADC.
+         * @brief DAC code for each step. A SweepTable in flash - codes[0] is the minimum of the sweep.
          */
-        uint16_t avg_num;
-        /**
-         * @brief The number of samples to take during the sweep. AKA the number of steps in the sweep.
-         */
-        uint16_t num_samples;
-        /**
-         * @brief The minimum and maximum values for the sweep.
-         */
-        uint16_t sweep_min;
-        uint16_t sweep_max;
+        const uint16_t* codes;
 
         /**
          * @brief Clears the data array.
-         * 
-         * @param data The data array to clear.
-         * @param size The size of the data array.
          */
-        void clear_data(uint16_t data[], uint16_t size);
+        void clear_data(){
+            if (!data) return;
+            for (int i = 0; i < Steps; i++){
+                data[i] = 0;
+            }
+        }
 
-        uint16_t read_adc();
+        uint16_t read_adc(){
+            return adc.adc_read();
+        }
+
+        /**
+         * @brief Average of Averages samples. Averages is a constant, so a power of two is a shift instead of a divide.
+         */
+        static uint16_t average(uint32_t total){
+            return (uint16_t)(((Averages & (Averages - 1)) == 0) ? (total >> log2(Averages)) : (total / Averages));
+        }
+        static constexpr int log2(uint32_t n){
+            return n <= 1 ? 0 : 1 + log2(n >> 1);
+        }
     public:
         /**
          * @brief Constructor for the Pip class. 
-         * 
+         * @param codes - the sweep, SweepTable<min, max, Steps>::codes. The array type makes sure it has Steps codes.
          */
-        Pip(int delay_us, uint16_t avg_num, uint16_t num_samples, uint16_t min, uint16_t max, uint8_t dac_pin, Max1148& adc);
+        Pip(int delay_us, const uint16_t (&codes)[Steps], uint8_t dac_pin, Max1148& adc)
+            : dac_pin(dac_pin), delay_us(delay_us), adc(adc), codes(codes), data(nullptr) {
+            hal::pin_mode(dac_pin, OUTPUT);
+            hal::dac_resolution(12);
+        }
         /**
-         * @brief The data array for the sweep.
+         * @brief Where this pip's sweep goes - Steps samples in the buffer given to PipController::sweep(). nullptr
+         * until the first sweep.
          */
-        uint16_t data[SWEEP_MAX_SAMPLES];
+        uint16_t* data;
 
 
 };
@@ -1,51 +1,291 @@
 #ifndef PIP_CONTROLLER_HPP
 #define PIP_CONTROLLER_HPP
 
-#include <Arduino.h>
+#include <HAL.hpp>
 #include <Pip.hpp>
+
+// Timer triggered DAC steps: DACC triggers per step (two per table word)
+#define PIP_DACC_TRIGGERS_PER_STEP 16
+#define PIP_DACC_WORDS_PER_STEP (PIP_DACC_TRIGGERS_PER_STEP / 2)
+
+/**
+ * @brief How PipController::sweep talks to the ADC.
+ * POLLED - the CPU exchanges every frame itself, through the Max1148's AdcTransport.
+ * DMA - the conversions for a whole step go out as one DMA transfer with hardware chip select. The CPU sums the
+ * previous step while it runs.
+ */
+enum class Acquisition : uint8_t{
+	POLLED,
+	DMA
+};
+
+/**
+ * @brief How conversions follow each other within a step.
+ * SINGLE - control byte then two result bytes per conversion, chip select raised after each (24 clocks).
+ * PIPELINED - one chip select for the whole step, alternating pip1/pip2 control bytes are clocked in with the second
+ * byte of the previous result (16 clocks per conversion).
+ */
+enum class Conversion : uint8_t{
+	SINGLE,
+	PIPELINED
+};
+
+/**
+ * @brief What steps the DACs.
+ * CPU - dac_write for each step, then delay_us for the preamp to settle.
+ * TIMER - the DAC codes for the whole sweep are in a table the PDC feeds to the DACC, and a TC channel triggers the
+ * conversions at a fixed step period. Step timing does not depend on the CPU or on interrupts. The ADC reads for a step
+ * start a fixed time after the hardware step edge.
+ */
+enum class DacStepping : uint8_t{
+	CPU,
+	TIMER
+};
+
 /**
- * @brief Manages simultaneous sweep for two Pip sensors.
+ * @brief Manages simultaneous sweep for Probes Pip sensors.
  * A bit hacky, but allows easily managing simultaneous sweeping while keeping data separate and clean.
+ * Steps and Averages come from the pips, so the DMA and DACC buffers are sized for this sweep exactly and the loops
+ * have constant bounds. Every probe is read on every step, interleaved probe by probe within each average, so a probe
+ * adds Averages ADC reads per step and shares the DAC step and settling delay with the rest.
+ *
+ * The pips are ADC channels of the one Max1148 (shared chip select). The Due has two DACs, so several probes can be on
+ * the same dac_pin.
+ * @code
+ * PipController<SWEEP_STEPS, SWEEP_AVERAGES, 4> pipController(pip0, pip1, pip2, pip3);
+ * @endcode
  */
+template <uint16_t Steps, uint16_t Averages, uint8_t Probes = 2>
 class PipController{
-	private:
-		Pip& pip1;
-		Pip& pip2;
+	static_assert(Probes >= 1, "need at least one probe");
 	public:
-		PipController(Pip& pip1, Pip& pip2) : pip1(pip1), pip2(pip2) {}
 		/**
-		 * @brief Sweeps both DACs simultaneously, reads both ADC channels. Note that ADC sampling alternates between each pip channel.
+		 * @brief Samples in a combined sweep, see sweep().
+		 */
+		static const size_t SWEEP_SAMPLES = (size_t)Probes * Steps;
+	private:
+		// Words for one step: a conversion per probe for each average
+		static const size_t DMA_STEP_WORDS = (size_t)Probes * Averages * MAX1148_DMA_WORDS;
+		static const size_t DACC_WORDS = (Steps - 1) * PIP_DACC_WORDS_PER_STEP + 1;
+		typedef Pip<Steps, Averages> SweepPip;
+		SweepPip* pips[Probes];
+		Acquisition acquisition;
+		Conversion conversion;
+		/**
+		 * @brief Words per step in dma_tx, and the stride of conversion results in dma_rx.
 		 */
-		void sweep(){
-			double value1 = pip1.sweep_min;
-			double value2 = pip2.sweep_min;
-			double step1 = (double)(pip1.sweep_max - pip1.sweep_min) / (double)(pip1.num_samples - 1);
-			double step2 = (double)(pip2.sweep_max - pip2.sweep_min) / (double)(pip2.num_samples - 1);
+		size_t dma_count;
+		size_t dma_stride;
+		/**
+		 * @brief SPI words for one step - a conversion for each probe in order, for each average. The same every step,
+		 * built once.
+		 */
+		uint32_t dma_tx[DMA_STEP_WORDS];
+		/**
+		 * @brief Received frames. Steps alternate between the two, so one can be summed while the other fills.
+		 */
+		uint16_t dma_rx[2][DMA_STEP_WORDS];
+		DacStepping stepping;
+		/**
+		 * @brief DACC words for the whole sweep. Step i is PIP_DACC_WORDS_PER_STEP copies of the same word, so DAC1
+		 * follows DAC0 by one trigger and both then hold until the next step. The last step has a single word, so the
+		 * DACC FIFO is empty by the time its ADC reads start.
+		 */
+		uint32_t dacc_table[DACC_WORDS];
+		size_t dacc_count;
+		uint32_t dacc_trigger_ticks;
+		uint32_t dacc_step_ticks;
+		/**
+		 * @brief Ticks from a step edge to the start of its ADC reads - DAC1's conversion plus the settling delay.
+		 */
+		uint32_t dacc_adc_ticks;
+		/**
+		 * @brief Steps whose ADC reads were still running when the next step started, since start up.
+		 */
+		uint32_t late_steps;
 
-			//set delay to max delay between the pips - should always be the same since
-			//both pips are configured the same
-			uint16_t delay = (pip1.delay_us < pip2.delay_us) ? pip1.delay_us : pip2.delay_us;
-			SPI.beginTransaction(SPISettings(SPI_SPEED, MSBFIRST, SPI_MODE));
-			for (int i = 0; i < pip1.num_samples; i++){
-				analogWrite(pip1.dac_pin, (int)value1);
-				analogWrite(pip2.dac_pin, (int)value2);
-				value1 += step1;
-				value2 += step2;
-				//preamp settling time - experimentally derived
-				delayMicroseconds(delay);
-				int total_data1 = 0;
-				int total_data2 = 0;
-				//avg_num should be same across both pips.
-				for (int i=0; i < pip1.avg_num; i++){
-					total_data1 += pip1.read_adc();
-					total_data2 += pip2.read_adc();
+		/**
+		 * @brief ADC to convert after probe p in an average's run, nullptr after the last probe of the last average.
+		 */
+		const Max1148* next_adc(int p, int average) const {
+			if (p + 1 < Probes) return &pips[p + 1]->adc;
+			return (average + 1 < Averages) ? &pips[0]->adc : nullptr;
+		}
+		/**
+		 * @brief Shortest settling delay of the probes. They should all be configured the same.
+		 */
+		uint16_t settle_delay() const {
+			uint16_t delay = pips[0]->delay_us;
+			for (int p = 1; p < Probes; p++){
+				if (pips[p]->delay_us < delay) delay = pips[p]->delay_us;
+			}
+			return delay;
+		}
+		/**
+		 * @brief DAC code of step for the DAC on pin - from the first probe on that DAC, or the first probe if none is.
+		 */
+		uint16_t dac_code(uint8_t pin, int step) const {
+			for (int p = 0; p < Probes; p++){
+				if (pips[p]->dac_pin == pin) return pips[p]->codes[step];
+			}
+			return pips[0]->codes[step];
+		}
+		/**
+		 * @brief Averages the conversions of one DMA step into the pip data arrays.
+		 */
+		void store_dma_step(int step, const uint16_t* rx){
+			uint32_t total[Probes] = {};
+			for (int i = 0; i < Averages; i++){
+				for (int p = 0; p < Probes; p++){
+					total[p] += pips[p]->adc.dma_result(rx);
+					rx += dma_stride;
+				}
+			}
+			for (int p = 0; p < Probes; p++){
+				pips[p]->data[step] = SweepPip::average(total[p]);
+			}
+		}
+		/**
+		 * @brief Counts a late step if the ADC reads of step finished after the DACs moved on to the next one.
+		 */
+		void check_late(int step){
+			if (stepping != DacStepping::TIMER || step + 1 >= Steps) return;
+			// The next step's first conversion is half a trigger period after its edge
+			if (hal::dac_sweep_ticks() > (step + 1) * dacc_step_ticks + dacc_trigger_ticks / 2) late_steps++;
+		}
+	public:
+		/**
+		 * @brief Takes one Pip per probe. Their samples follow each other in this order in sweep()'s buffer.
+		 */
+		template <class... Rest>
+		PipController(SweepPip& first, Rest&... rest)
+			: pips{&first, &rest...}, acquisition(Acquisition::POLLED), conversion(Conversion::SINGLE),
+			  dma_count(0), dma_stride(MAX1148_DMA_WORDS), stepping(DacStepping::CPU), dacc_count(0),
+			  dacc_trigger_ticks(0), dacc_step_ticks(0), dacc_adc_ticks(0), late_steps(0) {
+			static_assert(sizeof...(Rest) + 1 == Probes, "PipController needs one Pip per probe");
+		}
+		/**
+		 * @brief Selects how sweep() reads the ADC. Call after hal::spi_begin().
+		 */
+		void set_acquisition(Acquisition mode, Conversion conv = Conversion::SINGLE){
+			if (mode == Acquisition::DMA){
+				uint32_t* words = dma_tx;
+				if (conv == Conversion::PIPELINED){
+					*words++ = pips[0]->adc.dma_start_word();
+					for (int i = 0; i < Averages; i++){
+						for (int p = 0; p < Probes; p++){
+							dma_stride = pips[p]->adc.dma_words_next(words, next_adc(p, i));
+							words += dma_stride;
+						}
+					}
+				} else {
+					for (int i = 0; i < Averages; i++){
+						for (int p = 0; p < Probes; p++){
+							dma_stride = pips[p]->adc.dma_words(words);
+							words += dma_stride;
+						}
+					}
 				}
-				pip1.data[i] = (uint16_t)(total_data1 / pip1.avg_num);
-				pip2.data[i] = (uint16_t)(total_data2 / pip2.avg_num);
+				dma_count = words - dma_tx;
+			}
+			// All probes share the ADC chip select. Max1148::csl/csh need it on GPIO, DMA needs the SPI peripheral.
+			pips[0]->adc.claim_cs(mode == Acquisition::DMA);
+			acquisition = mode;
+			conversion = conv;
+		}
+		/**
+		 * @brief Selects what steps the DACs.
+		 * @param step_period_us - step length in TIMER mode. Must leave room for the settling delay and the ADC reads of
+		 * every probe, see get_late_steps().
+		 */
+		void set_dac_stepping(DacStepping mode, uint32_t step_period_us = 0){
+			if (mode == DacStepping::TIMER){
+				uint32_t* words = dacc_table;
+				for (int i = 0; i < Steps; i++){
+					uint32_t word = hal::dac_sweep_word(dac_code(DAC0, i), dac_code(DAC1, i));
+					int copies = (i + 1 < Steps) ? PIP_DACC_WORDS_PER_STEP : 1;
+					for (int c = 0; c < copies; c++) *words++ = word;
+				}
+				dacc_count = words - dacc_table;
+				dacc_trigger_ticks = step_period_us * DAC_SWEEP_TICKS_PER_US / PIP_DACC_TRIGGERS_PER_STEP;
+				dacc_step_ticks = dacc_trigger_ticks * PIP_DACC_TRIGGERS_PER_STEP;
+				// DAC1's half-word is converted on the second trigger, 3/2 trigger periods after the step starts
+				dacc_adc_ticks = dacc_trigger_ticks * 3 / 2 + settle_delay() * DAC_SWEEP_TICKS_PER_US;
+			}
+			stepping = mode;
+		}
+		DacStepping get_dac_stepping() const { return stepping; }
+		uint32_t get_late_steps() const { return late_steps; }
+		Acquisition get_acquisition() const { return acquisition; }
+		Conversion get_conversion() const { return conversion; }
+		/**
+		 * @brief Sweeps the DACs once, reads every probe's ADC channel on each step. Note that ADC sampling alternates
+		 * between the probes.
+		 * @param out - where the samples go, probe by probe: Steps per probe. Each Pip's data points at its part
+		 * afterwards. Typically the sweep field of a UART frame, so the samples are written where they are sent from.
+		 */
+		void sweep(uint16_t (&out)[SWEEP_SAMPLES]){
+			for (int p = 0; p < Probes; p++){
+				pips[p]->data = out + p * Steps;
+			}
+			uint16_t delay = settle_delay();
+			// The EEPROM may still be streaming a page over the DMAC, and the bus and channels are shared
+			while (hal::spi_dma_busy()){
+				;
+			}
+			hal::spi_begin_transaction(hal::SpiSettings(SPI_SPEED, MSBFIRST, SPI_MODE));
+			if (stepping == DacStepping::TIMER){
+				hal::dac_sweep_start(dacc_table, dacc_count, dacc_trigger_ticks);
+			}
+			for (int i = 0; i < Steps; i++){
+				if (stepping == DacStepping::TIMER){
+					//both DACs are on this step and settled
+					hal::dac_sweep_wait(i * dacc_step_ticks + dacc_adc_ticks);
+				} else {
+					hal::dac_write(DAC0, dac_code(DAC0, i));
+					hal::dac_write(DAC1, dac_code(DAC1, i));
+					//preamp settling time - experimentally derived
+					hal::delay_us(delay);
+				}
+				if (acquisition == Acquisition::DMA){
+					hal::spi_dma_start(dma_tx, dma_rx[i & 1], dma_count);
+					//sum the previous step while this one is on the bus
+					if (i > 0) store_dma_step(i - 1, dma_rx[(i - 1) & 1]);
+					while (hal::spi_dma_busy()){
+						;
+					}
+					check_late(i);
+					continue;
+				}
+				uint32_t total[Probes] = {};
+				if (conversion == Conversion::PIPELINED){
+					pips[0]->adc.pipeline_start();
+					for (int j = 0; j < Averages; j++){
+						for (int p = 0; p < Probes; p++){
+							total[p] += pips[p]->adc.pipeline_read(next_adc(p, j));
+						}
+					}
+				} else {
+					for (int j = 0; j < Averages; j++){
+						for (int p = 0; p < Probes; p++){
+							total[p] += pips[p]->read_adc();
+						}
+					}
+				}
+				for (int p = 0; p < Probes; p++){
+					pips[p]->data[i] = SweepPip::average(total[p]);
+				}
+				check_late(i);
+			}
+			if (acquisition == Acquisition::DMA){
+				store_dma_step(Steps - 1, dma_rx[(Steps - 1) & 1]);
+			}
+			if (stepping == DacStepping::TIMER){
+				hal::dac_sweep_stop();
 			}
-			analogWrite(pip1.dac_pin, pip1.sweep_min);
-			analogWrite(pip2.dac_pin, pip2.sweep_min);
-			SPI.endTransaction();
+			hal::dac_write(DAC0, dac_code(DAC0, 0));
+			hal::dac_write(DAC1, dac_code(DAC1, 0));
+			hal::spi_end_transaction();
 		}
 };
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,155 @@
+/**
+ * @file ReedSolomon.hpp
+ * @brief Reed-Solomon forward error correction for Framing::REED_SOLOMON records (see Telemetry.hpp).
+ *
+ * Shortened RS(k + RS_PARITY, k) over GF(256), primitive polynomial x^8 + x^4 + x^3 + x^2 + 1 (0x11D), generator roots
+ * alpha^0 to alpha^(RS_PARITY - 1). Systematic: the data goes out unchanged and RS_PARITY parity bytes follow it. The
+ * receiver can correct up to RS_PARITY / 2 bad bytes anywhere in the data and parity, k + RS_PARITY <= 255.
+ *
+ * The encoder is the usual shift register, one log and RS_PARITY exp table lookups per data byte, with the exp, log and
+ * generator tables built at compile time into flash. Like CobsEncoder it takes the data a piece at a time, so a record is
+ * encoded straight from its segments. The decoder (Berlekamp-Massey, Chien search, Forney) is host only.
+ */
+#ifndef REED_SOLOMON_HPP
+#define REED_SOLOMON_HPP
+#include <stdint.h>
+#include <stddef.h>
+
+#ifndef RS_PARITY
+#define RS_PARITY 8    // parity bytes per record, corrects RS_PARITY / 2 bad bytes
+#endif
+#define RS_BLOCK_MAX 255
+#define GF_POLY 0x11D
+
+namespace gf256 {
+    template <int... I> struct Indices {};
+    template <int N, int... I> struct MakeIndices : MakeIndices<N - 1, N - 1, I...> {};
+    template <int... I> struct MakeIndices<0, I...> { typedef Indices<I...> type; };
+
+    constexpr uint8_t times_alpha(uint8_t x){
+        return (x & 0x80) ? (uint8_t)((x << 1) ^ (GF_POLY & 0xFF)) : (uint8_t)(x << 1);
+    }
+
+    /**
+     * @brief alpha^i.
+     */
+    constexpr uint8_t exp(int i, uint8_t power = 1){
+        return i % 255 == 0 ? power : exp(i % 255 - 1, times_alpha(power));
+    }
+
+    /**
+     * @brief i such that alpha^i = x, searching up from alpha^i = power. 0 for x = 0, which has none.
+     */
+    constexpr uint8_t log(uint8_t x, int i = 0, uint8_t power = 1){
+        return x == 0 || i == 255 ? 0 : power == x ? (uint8_t)i : log(x, i + 1, times_alpha(power));
+    }
+
+    /**
+     * @brief Shift and add, so the tables are not needed to build the tables.
+     */
+    constexpr uint8_t mul(uint8_t a, uint8_t b){
+        return b == 0 ? 0 : (uint8_t)(((b & 1) ? a : 0) ^ mul(times_alpha(a), b >> 1));
+    }
+
+    template <int K, class = typename MakeIndices<RS_PARITY + 1>::type> struct Generator;
+
+    /**
+     * @brief (x + alpha^0)(x + alpha^1)...(x + alpha^(K - 1)), coefficients lowest degree first. Each one is built from
+     * the one before, so the compiler only works out each product once.
+     */
+    template <int K, int... J>
+    struct Generator<K, Indices<J...> > {
+        typedef Generator<K - 1> Previous;
+        static constexpr uint8_t coefficient(int j){
+            return (uint8_t)((j > 0 ? Previous::coefficients[j - 1] : 0) ^ mul(Previous::coefficients[j], exp(K - 1)));
+        }
+        static constexpr uint8_t coefficients[RS_PARITY + 1] = { coefficient(J)... };
+    };
+
+    template <int... J>
+    struct Generator<0, Indices<J...> > {
+        static constexpr uint8_t coefficients[RS_PARITY + 1] = { (uint8_t)(J == 0)... };
+    };
+
+    template <int K, int... J>
+    constexpr uint8_t Generator<K, Indices<J...> >::coefficients[RS_PARITY + 1];
+    template <int... J>
+    constexpr uint8_t Generator<0, Indices<J...> >::coefficients[RS_PARITY + 1];
+
+    template <class = MakeIndices<2 * 255>::type, class = MakeIndices<256>::type, class = MakeIndices<RS_PARITY>::type>
+    struct Tables;
+
+    /**
+     * @brief exp has two periods so exp[log a + log b] needs no mod 255. generator_log[j] is the log of the coefficient
+     * of x^j of the generator, the x^RS_PARITY one being 1.
+     */
+    template <int... E, int... L, int... G>
+    struct Tables<Indices<E...>, Indices<L...>, Indices<G...> > {
+        static constexpr uint8_t exp[2 * 255] = { gf256::exp(E)... };
+        static constexpr uint8_t log[256] = { gf256::log((uint8_t)L)... };
+        static constexpr uint8_t generator_log[RS_PARITY] = { gf256::log(Generator<RS_PARITY>::coefficients[G])... };
+    };
+
+    template <int... E, int... L, int... G>
+    constexpr uint8_t Tables<Indices<E...>, Indices<L...>, Indices<G...> >::exp[2 * 255];
+    template <int... E, int... L, int... G>
+    constexpr uint8_t Tables<Indices<E...>, Indices<L...>, Indices<G...> >::log[256];
+    template <int... E, int... L, int... G>
+    constexpr uint8_t Tables<Indices<E...>, Indices<L...>, Indices<G...> >::generator_log[RS_PARITY];
+
+    constexpr bool generator_nonzero(int j = 0){
+        return j == RS_PARITY || (Generator<RS_PARITY>::coefficients[j] != 0 && generator_nonzero(j + 1));
+    }
+}
+
+static_assert(RS_PARITY >= 2 && RS_PARITY % 2 == 0 && RS_PARITY < RS_BLOCK_MAX, "RS_PARITY has to be even");
+static_assert(gf256::generator_nonzero(), "the encoder keeps generator coefficients as logs");
+
+/**
+ * @brief Computes the parity of one block.
+ * @code
+ * RsEncoder block;
+ * block.put(header, sizeof(header));
+ * block.put(data, sizeof(data));
+ * block.finish(parity);  // RS_PARITY bytes
+ * @endcode
+ */
+class RsEncoder {
+private:
+    uint8_t remainder[RS_PARITY];  // highest degree first, sent in this order
+
+public:
+    RsEncoder() : remainder() {}
+
+    void put(const void* data, size_t length){
+        typedef gf256::Tables<> T;
+        const uint8_t* bytes = (const uint8_t*)data;
+        for (size_t n = 0; n < length; n++){
+            uint8_t feedback = bytes[n] ^ remainder[0];
+            if (feedback == 0){
+                for (int i = 0; i < RS_PARITY - 1; i++) remainder[i] = remainder[i + 1];
+                remainder[RS_PARITY - 1] = 0;
+                continue;
+            }
+            uint8_t f = T::log[feedback];
+            for (int i = 0; i < RS_PARITY - 1; i++){
+                remainder[i] = remainder[i + 1] ^ T::exp[f + T::generator_log[RS_PARITY - 1 - i]];
+            }
+            remainder[RS_PARITY - 1] = T::exp[f + T::generator_log[0]];
+        }
+    }
+
+    void finish(uint8_t (&parity)[RS_PARITY]) const {
+        for (int i = 0; i < RS_PARITY; i++) parity[i] = remainder[i];
+    }
+};
+
+#ifndef ARDUINO
+/**
+ * @brief Corrects a block, data then RS_PARITY parity bytes, in place.
+ * @param length data + parity, at most RS_BLOCK_MAX
+ * @return bytes corrected, or -1 if there were more errors than the code can correct (block is left alone)
+ */
+int rsDecode(uint8_t* block, size_t length);
+#endif
+#endif
@@ -0,0 +1,27 @@
+/**
+ * @file ShieldSim.hpp
+ * @brief Discrete-event simulation of a whole flight on the host.
+ *
+ * Runs the real setup()/loop() from main.cpp - FSMUpdate, FSMAction, TC0_Handler and syncHandler - against the simulated
+ * shield in HALSim.hpp. Sync pulses arrive as scheduled events every sample period and virtual time jumps straight to the
+ * next event whenever the state machine is only waiting on a flag, so a 15 minute flight runs in seconds.
+ *
+ * Reports time spent in each state, missed cycles, UART bytes per cycle, EEPROM backlog and how fast it drains over the
+ * flight, and the records replayed. Sweep size can be scaled by rebuilding with e.g. -DSWEEP_STEPS=40 or -DSWEEP_AVERAGES=16.
+ */
+#ifndef SHIELD_SIM_HPP
+#define SHIELD_SIM_HPP
+#ifndef ARDUINO
+/**
+ * @brief Runs a flight and prints the report.
+ *
+ * Options:
+ *   --seconds N        flight length (default 900)
+ *   --period US        sync pulse period (default SAMPLE_PERIOD, 22222)
+ *   --sync-off A:B     no sync pulses between A and B seconds (loss of signal)
+ *   --capture FILE     write every byte the UART sent to FILE
+ * @return process exit code
+ */
+int runFlight(int argc, char** argv);
+#endif
+#endif
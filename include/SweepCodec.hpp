@@ -0,0 +1,60 @@
+/**
+ * @file SweepCodec.hpp
+ * @brief Lossless predictive coding of sweeps for the ##s/##t records (see Telemetry.hpp).
+ *
+ * The steps of a Langmuir sweep follow a smooth curve and every probe sweeps the same curve, so each sample is predicted
+ * and only the residual is sent, Rice coded. Each probe picks one of two predictors:
+ *
+ * SWEEP_PREDICT_STEPS - from its own last two steps, 2 * x[i - 1] - x[i - 2] (x[0] for step 1). Step 0 is sent as is.
+ * SWEEP_PREDICT_PROBE - from the probe before it, y[i] + x[i - 1] - y[i - 1] (y[0] for step 0). Not for probe 0.
+ *
+ * Predictions are clamped to 0..65535, so a residual fits in 17 bits. Residuals are folded to unsigned (0, -1, 1, -2 ...
+ * become 0, 1, 2, 3 ...) and Rice coded with a parameter k per probe: u >> k in unary (that many 1 bits then a 0), then
+ * the low k bits of u. A quotient of SWEEP_RICE_ESCAPE or more is sent as SWEEP_RICE_ESCAPE 1 bits and u in 17 bits, so a
+ * residual never costs more than 33 bits.
+ *
+ * Stream, most significant bit first, for each probe: predictor (1 bit), k (4 bits), step 0 in 16 bits if the predictor
+ * is SWEEP_PREDICT_STEPS, then the residuals. The last byte is padded with 0 bits.
+ *
+ * Integer only: k comes from the mean residual (the smallest k with count << k >= sum, as in LOCO-I) and the predictor
+ * from the smaller residual sum, so the encoder is two passes over the sweep with adds and shifts, a few microseconds on
+ * the SAM3X.
+ */
+#ifndef SWEEP_CODEC_HPP
+#define SWEEP_CODEC_HPP
+#include <stdint.h>
+#include <stddef.h>
+
+#define SWEEP_PREDICT_STEPS 0
+#define SWEEP_PREDICT_PROBE 1
+#define SWEEP_RICE_K_BITS 4
+#define SWEEP_RICE_K_MAX 15
+#define SWEEP_RICE_ESCAPE 16   // quotient that is sent as an escape instead
+#define SWEEP_RESIDUAL_BITS 17 // escaped residual, folded
+
+/**
+ * @brief How sendData() sends sweeps.
+ *
+ * RAW - ##S and ##T, every sample in 16 bits.
+ * RICE - ##s and ##t, coded with sweepEncode(), or ##S and ##T for any sweep that does not code shorter. About half the
+ * size for a typical sweep, which leaves room on the link for more SWEEP_STEPS or a shorter SAMPLE_PERIOD.
+ */
+enum class SweepCoding {
+    RAW,
+    RICE
+};
+
+/**
+ * @brief Codes a sweep, probe 0's steps first, into out.
+ * @return bytes written, or 0 if the coded sweep would not fit in capacity bytes (send it raw)
+ */
+size_t sweepEncode(const uint16_t* sweep, size_t steps, size_t probes, uint8_t* out, size_t capacity);
+
+#ifndef ARDUINO
+/**
+ * @brief Decodes a sweep coded by sweepEncode() into steps * probes samples.
+ * @return false if in is not exactly one coded sweep of that size
+ */
+bool sweepDecode(const uint8_t* in, size_t length, size_t steps, size_t probes, uint16_t* sweep);
+#endif
+#endif
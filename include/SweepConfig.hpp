@@ -0,0 +1,24 @@
+/**
+ * @file SweepConfig.hpp
+ * @brief Sweep size, shared by main.cpp and the native build.
+ *
+ * Pip and PipController are sized at compile time by the number of steps, averages and probes, so anything that names
+ * their types needs these. Both can be overridden with -D in platformio.ini, e.g. to try scaling in the simulator.
+ */
+#ifndef SWEEP_CONFIG_HPP
+#define SWEEP_CONFIG_HPP
+#include <PipController.hpp>
+
+#ifndef SWEEP_STEPS
+#define SWEEP_STEPS        28               // Number of steps in sweep
+#endif
+#ifndef SWEEP_AVERAGES
+#define SWEEP_AVERAGES     8                // each sample ~20-21 us
+#endif
+#ifndef SWEEP_PROBES
+#define SWEEP_PROBES       2                // Pips swept together, one ADC channel each. main.cpp passes each one to pipController
+#endif
+
+typedef Pip<SWEEP_STEPS, SWEEP_AVERAGES> SweepPip;
+typedef PipController<SWEEP_STEPS, SWEEP_AVERAGES, SWEEP_PROBES> SweepController;
+#endif
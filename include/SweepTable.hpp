@@ -0,0 +1,54 @@
+/**
+ * @file SweepTable.hpp
+ * @brief DAC code tables for the Pip sweeps, generated at compile time.
+ *
+ * The sweep used to compute each step on the fly: a double step size, accumulated into a double and truncated to int
+ * before analogWrite. The Due has no FPU, so that was software floating point on every step. SweepTable<Min, Max, Steps>
+ * runs exactly that arithmetic in the compiler instead and leaves a const uint16_t table in flash, so the codes are
+ * bit for bit the ones the old loop produced.
+ *
+ * Written for C++11 (the Due toolchain), hence the recursion instead of loops.
+ */
+#ifndef SWEEP_TABLE_HPP
+#define SWEEP_TABLE_HPP
+#include <stdint.h>
+
+namespace sweep_table {
+    template <int... I> struct Indices {};
+    template <int N, int... I> struct MakeIndices : MakeIndices<N - 1, N - 1, I...> {};
+    template <int... I> struct MakeIndices<0, I...> { typedef Indices<I...> type; };
+
+    /**
+     * @brief value + step added i times, one addition at a time like the old loop, so rounding matches.
+     */
+    constexpr double accumulate(double value, double step, int i){
+        return i == 0 ? value : accumulate(value + step, step, i - 1);
+    }
+
+    /**
+     * @brief Code for step i of a sweep from min to max in steps steps.
+     */
+    constexpr uint16_t code(uint16_t min, uint16_t max, uint16_t steps, int i){
+        return (uint16_t)(int)accumulate((double)min, (double)(max - min) / (double)(steps - 1), i);
+    }
+}
+
+template <uint16_t Min, uint16_t Max, uint16_t Steps, class = typename sweep_table::MakeIndices<Steps>::type>
+struct SweepTable;
+
+/**
+ * @brief DAC codes of a sweep from Min to Max in Steps steps.
+ * @code
+ * SweepPip pip0(SWEEP_DELAY, SweepTable<339, 3752, SWEEP_STEPS>::codes, DAC0, adc0);
+ * @endcode
+ */
+template <uint16_t Min, uint16_t Max, uint16_t Steps, int... I>
+struct SweepTable<Min, Max, Steps, sweep_table::Indices<I...> > {
+    static_assert(Steps >= 2, "a sweep needs at least two steps");
+    static_assert(Min <= Max && Max <= 4095, "sweep range must fit the 12-bit DAC");
+    static constexpr uint16_t codes[Steps] = { sweep_table::code(Min, Max, Steps, I)... };
+};
+
+template <uint16_t Min, uint16_t Max, uint16_t Steps, int... I>
+constexpr uint16_t SweepTable<Min, Max, Steps, sweep_table::Indices<I...> >::codes[Steps];
+#endif
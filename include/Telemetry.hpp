@@ -0,0 +1,340 @@
+/**
+ * @file Telemetry.hpp
+ * @brief Layout of the telemetry records, declared once for the firmware and the ground decoder.
+ *
+ * A record is a 3 byte sentinel ("##" and an ID letter) followed by a list of fields, each a type and a count:
+ * @code
+ * typedef telemetry::Record<'I', telemetry::Field<uint32_t>, telemetry::Field<int16_t, IMU_VALUES> > ImuRecord;
+ * @endcode
+ * Sizes and offsets come out of the list at compile time. The firmware side, gather(), turns a record into PDC segments
+ * pointing at the variables it is sent from, and only compiles if each variable has the field's type and count, so the
+ * frame cannot drift from the layout. The ground side, unpack(), copies the fields back out of received bytes.
+ *
+ * A PayloadRecord ends in a variable number of bytes instead, e.g. a coded sweep, after a length field.
+ *
+ * Records go out one of three ways, see Framing. Both ends are little-endian (the SAM3X and any x86/ARM host), so fields go over the link as they are in memory.
+ * Written for C++11 (the Due toolchain), hence the recursive templates.
+ */
+#ifndef TELEMETRY_HPP
+#define TELEMETRY_HPP
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <SweepConfig.hpp>
+#include <IMU.hpp>
+#include <Cobs.hpp>
+#include <ReedSolomon.hpp>
+#include <SweepCodec.hpp>
+#include <Counters.hpp>
+
+#define TELEMETRY_SENTINEL_LEN 3
+
+/**
+ * @brief How records are delimited on the downlink.
+ *
+ * SENTINEL - "##" and the ID, then the fields, sent straight from where they live. No integrity check, and the ground has
+ * to find record boundaries by looking for sentinels.
+ * COBS - the ID, the fields and a CRC-16, COBS encoded and ended by a zero byte (see Cobs.hpp). Costs an encoding pass
+ * into a buffer and a couple of bytes per record over SENTINEL (the "##" is dropped), but the ground finds every boundary
+ * with memchr and throws away any record the link corrupted.
+ * REED_SOLOMON - SENTINEL records, each followed by RS_PARITY Reed-Solomon parity bytes over the sentinel and fields
+ * (see ReedSolomon.hpp). The parity is computed from the same segments and sent as one more segment, so nothing is
+ * copied. The ground repairs up to RS_PARITY / 2 bad bytes per record, sentinel included, instead of losing the sweep.
+ * RS_PARITY 8 adds 32 bytes to a 294 byte frame.
+ */
+enum class Framing {
+    SENTINEL,
+    COBS,
+    REED_SOLOMON
+};
+
+/**
+ * @brief Bytes a record of size bytes, sentinel included, takes on the link with framing.
+ */
+constexpr size_t wireSize(Framing framing, size_t size){
+    return framing == Framing::COBS ? cobsEncodedSize(size - TELEMETRY_SENTINEL_LEN + 1)
+         : framing == Framing::REED_SOLOMON ? size + RS_PARITY : size;
+}
+
+namespace telemetry {
+    /**
+     * @brief Count values of type T. Arguments for a field are a T, or a T[Count] when Count > 1.
+     */
+    template <class T, size_t Count = 1>
+    struct Field {
+        typedef T type;
+        typedef const T (&arg)[Count];
+        typedef T (&out)[Count];
+        typedef T storage[Count];
+        static const size_t count = Count;
+        static const size_t size = sizeof(T) * Count;
+        static const void* address(arg value){ return value; }
+    };
+
+    template <class T>
+    struct Field<T, 1> {
+        typedef T type;
+        typedef const T& arg;
+        typedef T& out;
+        typedef T storage;
+        static const size_t count = 1;
+        static const size_t size = sizeof(T);
+        static const void* address(arg value){ return &value; }
+    };
+
+    template <size_t I, class... Fields> struct FieldAt;
+
+    /**
+     * @brief Field I of a field list, and its offset from the first one.
+     */
+    template <class First, class... Rest>
+    struct FieldAt<0, First, Rest...> {
+        typedef First type;
+        static const size_t offset = 0;
+    };
+
+    template <size_t I, class First, class... Rest>
+    struct FieldAt<I, First, Rest...> {
+        typedef typename FieldAt<I - 1, Rest...>::type type;
+        static const size_t offset = First::size + FieldAt<I - 1, Rest...>::offset;
+    };
+
+    template <class... Fields> struct SizeOf;
+    template <> struct SizeOf<> { static const size_t value = 0; };
+    template <class First, class... Rest>
+    struct SizeOf<First, Rest...> { static const size_t value = First::size + SizeOf<Rest...>::value; };
+
+    /**
+     * @brief Fields packed back to back with no sentinel, e.g. one cycle as it is stored in the EEPROM.
+     *
+     * Segment is anything aggregate initialisable from {const void*, uint16_t}, e.g. TxSegment from PDC.hpp.
+     */
+    template <class... Fields>
+    struct Layout {
+        static const size_t fields = sizeof...(Fields);
+        static const size_t size = SizeOf<Fields...>::value;
+
+        template <size_t I>
+        struct field {
+            typedef typename FieldAt<I, Fields...>::type type;
+            static const size_t offset = FieldAt<I, Fields...>::offset;
+        };
+
+        /**
+         * @brief Writes one segment per field to out, pointing at the arguments. Returns the end of what it wrote.
+         */
+        template <class Segment>
+        static Segment* gather(Segment* out, typename Fields::arg... values){
+            const Segment segments[] = { {Fields::address(values), (uint16_t)Fields::size}... };
+            for (size_t i = 0; i < fields; i++){
+                out[i] = segments[i];
+            }
+            return out + fields;
+        }
+
+        /**
+         * @brief Field I of a packed buffer of this layout, e.g. the EEPROM read-back, to hand to gather() in turn.
+         * Only for sending straight from the buffer, so the field only has to be aligned for the compiler's sake.
+         */
+        template <size_t I>
+        static typename field<I>::type::arg at(const uint8_t* packed){
+            typedef typename field<I>::type F;
+            static_assert(field<I>::offset % alignof(typename F::type) == 0, "packed field is misaligned");
+            return *reinterpret_cast<const typename F::storage*>(packed + field<I>::offset);
+        }
+
+        /**
+         * @brief Copies size bytes of this layout out of in, one field per argument. Returns the end of what it read.
+         */
+        static const uint8_t* unpack(const uint8_t* in, typename Fields::out... values){
+            void* const addresses[] = { (void*)Fields::address(values)... };
+            const size_t sizes[] = { Fields::size... };
+            for (size_t i = 0; i < fields; i++){
+                memcpy(addresses[i], in, sizes[i]);
+                in += sizes[i];
+            }
+            return in;
+        }
+    };
+
+    /**
+     * @brief A sentinel "##" Id, then the fields. size counts the sentinel.
+     */
+    template <char Id, class... Fields>
+    struct Record {
+        typedef telemetry::Layout<Fields...> Layout;
+        static const char id = Id;
+        static const size_t size = TELEMETRY_SENTINEL_LEN + Layout::size;
+        static const size_t segments = 1 + Layout::fields;
+        static const size_t framed_size = cobsEncodedSize(1 + Layout::size);  // Framing::COBS, worst case
+        static const uint8_t sentinel[TELEMETRY_SENTINEL_LEN];
+
+        /**
+         * @brief Segments for the sentinel and each field, see Layout::gather().
+         */
+        template <class Segment>
+        static Segment* gather(Segment* out, typename Fields::arg... values){
+            const Segment head = {sentinel, TELEMETRY_SENTINEL_LEN};
+            *out = head;
+            return Layout::gather(out + 1, values...);
+        }
+
+        /**
+         * @brief Framing::COBS: encodes the ID and the fields, with the CRC and delimiter, into out, which has room for
+         * framed_size bytes. Returns the end of what it wrote.
+         */
+        static uint8_t* encode(uint8_t* out, typename Fields::arg... values){
+            struct Piece {
+                const void* data;
+                uint16_t length;
+            };
+            Piece pieces[Layout::fields];
+            Layout::gather(pieces, values...);
+            CobsEncoder packet(out);
+            packet.put(&sentinel[TELEMETRY_SENTINEL_LEN - 1], 1);
+            for (size_t i = 0; i < Layout::fields; i++){
+                packet.put(pieces[i].data, pieces[i].length);
+            }
+            return packet.finish();
+        }
+
+        /**
+         * @brief Whether in starts with this record's sentinel.
+         */
+        static bool matches(const uint8_t* in){
+            return memcmp(in, sentinel, TELEMETRY_SENTINEL_LEN) == 0;
+        }
+
+        /**
+         * @brief Unpacks a whole record, sentinel included, see Layout::unpack(). Check matches() first.
+         */
+        static const uint8_t* unpack(const uint8_t* in, typename Fields::out... values){
+            return Layout::unpack(in + TELEMETRY_SENTINEL_LEN, values...);
+        }
+    };
+
+    template <char Id, class... Fields>
+    const uint8_t Record<Id, Fields...>::sentinel[TELEMETRY_SENTINEL_LEN] = {'#', '#', (uint8_t)Id};
+
+    /**
+     * @brief Up to Max bytes to end a PayloadRecord with.
+     */
+    template <size_t Max>
+    struct Payload {
+        static const size_t max = Max;
+        uint16_t length;
+        uint8_t bytes[Max];
+    };
+
+    /**
+     * @brief A Record of the fields and a uint16_t length, then that many bytes of payload. size() of a received one comes
+     * from its length field, so the header has to have arrived. The payload goes first in the argument lists.
+     */
+    template <char Id, size_t Max, class... Fields>
+    struct PayloadRecord {
+        typedef telemetry::Payload<Max> Payload;
+        typedef telemetry::Record<Id, Fields..., Field<uint16_t> > Header;
+        static const char id = Id;
+        static const size_t header_size = Header::size;
+        static const size_t max_size = Header::size + Max;
+        static const size_t segments = Header::segments + 1;
+        static const size_t framed_size = cobsEncodedSize(1 + Header::Layout::size + Max);  // Framing::COBS, worst case
+
+        /**
+         * @brief Length of the record in, at least header_size bytes that match().
+         */
+        static size_t size(const uint8_t* in){
+            return header_size + (in[header_size - 2] | (size_t)in[header_size - 1] << 8);
+        }
+
+        template <class Segment>
+        static Segment* gather(Segment* out, const Payload& payload, typename Fields::arg... values){
+            out = Header::gather(out, values..., payload.length);
+            const Segment tail = {payload.bytes, payload.length};
+            *out = tail;
+            return out + 1;
+        }
+
+        static uint8_t* encode(uint8_t* out, const Payload& payload, typename Fields::arg... values){
+            struct Piece {
+                const void* data;
+                uint16_t length;
+            };
+            Piece pieces[Header::Layout::fields];
+            Header::Layout::gather(pieces, values..., payload.length);
+            CobsEncoder packet(out);
+            packet.put(&Header::sentinel[TELEMETRY_SENTINEL_LEN - 1], 1);
+            for (size_t i = 0; i < Header::Layout::fields; i++){
+                packet.put(pieces[i].data, pieces[i].length);
+            }
+            packet.put(payload.bytes, payload.length);
+            return packet.finish();
+        }
+
+        static bool matches(const uint8_t* in){
+            return Header::matches(in);
+        }
+
+        /**
+         * @brief Unpacks the fields and points payload at the payload in in. Returns its length.
+         */
+        static size_t unpack(const uint8_t* in, const uint8_t*& payload, typename Fields::out... values){
+            uint16_t length;
+            payload = Header::unpack(in, values..., length);
+            return length;
+        }
+    };
+}
+
+//========== Shield records ==========//
+// The sweep of every probe, probe 0's steps first
+typedef telemetry::Field<uint16_t, SweepController::SWEEP_SAMPLES> SweepField;
+typedef telemetry::Field<int16_t, IMU_VALUES> ImuField;
+typedef telemetry::Field<uint32_t> TimeStampField;  // us since setup()
+typedef telemetry::Field<uint8_t> ShieldIdField;
+
+/**
+ * @brief Sweep record, "##S" live and "##T" replayed from the EEPROM: timestamp, shield ID, sweep.
+ */
+template <char Id> using SweepRecordOf = telemetry::Record<Id, TimeStampField, ShieldIdField, SweepField>;
+/**
+ * @brief IMU record, "##I" live and "##J" replayed from the EEPROM: timestamp, IMU values.
+ */
+template <char Id> using ImuRecordOf = telemetry::Record<Id, TimeStampField, ImuField>;
+
+typedef SweepRecordOf<'S'> SweepRecord;
+typedef SweepRecordOf<'T'> StoredSweepRecord;
+typedef ImuRecordOf<'I'> ImuRecord;
+typedef ImuRecordOf<'J'> StoredImuRecord;
+
+// Coded sweeps are always shorter than ##S/##T, length field included, or they go raw
+#define SWEEP_CODED_MAX (SweepField::size - sizeof(uint16_t) - 1)
+/**
+ * @brief Coded sweep record, "##s" live and "##t" replayed, for SweepCoding::RICE: timestamp, shield ID, coded length,
+ * then the sweep coded with sweepEncode().
+ */
+template <char Id> using CodedSweepRecordOf = telemetry::PayloadRecord<Id, SWEEP_CODED_MAX, TimeStampField, ShieldIdField>;
+
+typedef CodedSweepRecordOf<'s'> CodedSweepRecord;
+typedef CodedSweepRecordOf<'t'> StoredCodedSweepRecord;
+typedef CodedSweepRecord::Payload CodedSweep;
+
+/**
+ * @brief Housekeeping record "##H", every HOUSEKEEPING_CYCLES cycles: timestamp, then the counters in Counters.hpp.
+ */
+typedef telemetry::Field<uint32_t, NUM_COUNTERS> CounterField;
+typedef telemetry::Record<'H', TimeStampField, CounterField> HousekeepingRecord;
+
+/**
+ * @brief One cycle as storeData() writes it to the EEPROM: IMU timestamp and values, sweep timestamp and sweep. Replayed
+ * as ##J and ##T, with the shield ID put back in.
+ */
+typedef telemetry::Layout<TimeStampField, ImuField, TimeStampField, SweepField> StoredCycle;
+
+static_assert(SweepRecord::size == 8 + 2 * SweepController::SWEEP_SAMPLES, "##S is sentinel, timestamp, ID, sweep");
+static_assert(ImuRecord::size == 7 + 2 * IMU_VALUES, "##I is sentinel, timestamp, IMU values");
+static_assert(CodedSweepRecord::max_size < SweepRecord::size && CodedSweepRecord::framed_size <= SweepRecord::framed_size,
+              "a sweep only goes coded if that is shorter");
+static_assert(StoredCycle::size == ImuRecord::size + SweepRecord::size - 2 * TELEMETRY_SENTINEL_LEN - 1,
+              "a stored cycle is both records without sentinels or shield ID");
+#endif
@@ -0,0 +1,153 @@
+/**
+ * @file TelemetryDecoder.hpp
+ * @brief Ground side decoder for the ##S/##I/##T/##J (and ##s/##t, ##H) stream sendData() puts on the UART.
+ *
+ * Host only. Record layouts come from Telemetry.hpp, so the decoder always matches the firmware it was built with. The
+ * stream is fed in as it arrives, in chunks of any size: a memory mapped capture file is one chunk, a serial port is
+ * whatever read() returns. Records are decoded into columns, one vector per field, in the order they arrived.
+ *
+ * Sync: a record is only taken if the next sentinel follows right where it ends (or the stream ends there), so a record
+ * that lost or gained a byte is dropped rather than decoded shifted, and sweep data that happens to contain "##S" does
+ * not lock the decoder onto garbage. When a record does not check out the decoder searches ahead for the next "##" and
+ * record ID, 16 or 32 bytes at a time with SSE2 or AVX2 on x86 (picked at run time), and locks back on only if the two
+ * records from there are back to back with the sentinels where their lengths put them. It counts the bytes it skipped
+ * and the times it lost sync.
+ *
+ * With Framing::COBS records end at a zero byte instead, see Cobs.hpp. The decoder splits the stream at zeros with
+ * memchr, drops a packet without decoding it if its length cannot be that of the record its ID names, and otherwise
+ * drops it if the CRC does not match. Dropped packets are counted in rejected.
+ *
+ * With Framing::REED_SOLOMON each record is followed by its parity. The decoder repairs each block before taking it (see
+ * scan_blocks() for how it decides where blocks are), counting the bytes it corrected and the blocks it could not save.
+ *
+ * Coded sweeps (##s and ##t, SweepCoding::RICE) are decoded with sweepDecode() into the same columns as ##S and ##T. One
+ * that does not decode to exactly its length is treated like a record that does not check out.
+ *
+ * IMU values are int16 on the shield and go out as two's complement, little-endian. They are decoded as int16 here, so
+ * negative readings come out negative (reading them as uint16 was the mistake the note in PDC.hpp warns about).
+ */
+#ifndef TELEMETRY_DECODER_HPP
+#define TELEMETRY_DECODER_HPP
+#ifndef ARDUINO
+#include <Telemetry.hpp>
+#include <vector>
+
+/**
+ * @brief Sweep records of one kind (##S or ##T). Record i is time_stamp[i], shield_id[i] and
+ * samples[i * SWEEP_SAMPLES] to samples[(i + 1) * SWEEP_SAMPLES - 1], probe 0's steps first.
+ */
+struct SweepColumns {
+    static const size_t SAMPLES = SweepField::count;
+    std::vector<uint32_t> time_stamp;
+    std::vector<uint8_t> shield_id;
+    std::vector<uint16_t> samples;
+    size_t size() const { return time_stamp.size(); }
+};
+
+/**
+ * @brief IMU records of one kind (##I or ##J). Record i is time_stamp[i] and values[i * VALUES] onwards: magnetometer,
+ * accelerometer and gyro x/y/z, then the spare value.
+ */
+struct ImuColumns {
+    static const size_t VALUES = ImuField::count;
+    std::vector<uint32_t> time_stamp;
+    std::vector<int16_t> values;
+    size_t size() const { return time_stamp.size(); }
+};
+
+/**
+ * @brief Housekeeping records (##H). Record i is time_stamp[i] and counters[i * COUNTERS] onwards, in Counter order
+ * (see Counters.hpp).
+ */
+struct HousekeepingColumns {
+    static const size_t COUNTERS = CounterField::count;
+    std::vector<uint32_t> time_stamp;
+    std::vector<uint32_t> counters;
+    size_t size() const { return time_stamp.size(); }
+};
+
+/**
+ * @brief Everything decoded so far.
+ */
+struct DecodedTelemetry {
+    SweepColumns sweeps;         // ##S, live
+    SweepColumns stored_sweeps;  // ##T, replayed from the EEPROM
+    ImuColumns imu;              // ##I, live
+    ImuColumns stored_imu;       // ##J, replayed from the EEPROM
+    HousekeepingColumns housekeeping;  // ##H
+    uint64_t bytes;              // bytes fed in
+    uint64_t skipped;            // bytes that were not part of a record
+    uint64_t resyncs;            // times sync was lost
+    uint64_t rejected;           // Framing::COBS packets dropped for their length or CRC, REED_SOLOMON blocks beyond repair
+    uint64_t corrected;          // Framing::REED_SOLOMON bytes repaired
+    uint64_t coded;              // ##s and ##t records, decoded into sweeps and stored_sweeps
+};
+
+class TelemetryDecoder {
+private:
+    DecodedTelemetry out;
+    Framing framing;
+    std::vector<uint8_t> carry;  // start of a record the last chunk cut off
+    bool locked;                 // the last record ended where this one starts, for counting resyncs
+    bool dropping;               // Framing::COBS: in a packet already rejected for its length, skip to its delimiter
+    std::vector<uint8_t> packet; // the COBS packet (decoded behind a "##" so take() can read it) or RS block being checked
+
+    size_t scan(const uint8_t* data, size_t length, bool final);
+    size_t scan_sentinels(const uint8_t* data, size_t length, bool final);
+    size_t scan_packets(const uint8_t* data, size_t length, bool final);
+    size_t scan_blocks(const uint8_t* data, size_t length, bool final);
+    int repair(const uint8_t* in, size_t size);
+    void take_packet(const uint8_t* in, size_t length);
+    bool take(const uint8_t* in);
+    void lose_sync();
+
+public:
+    explicit TelemetryDecoder(Framing framing = Framing::SENTINEL);
+
+    /**
+     * @brief Reserves column space for about bytes of input, so a whole capture decodes without reallocating.
+     */
+    void reserve(size_t bytes);
+
+    /**
+     * @brief Decodes the next length bytes of the stream. A record cut off at the end is kept until the next call.
+     */
+    void feed(const uint8_t* data, size_t length);
+
+    /**
+     * @brief End of the stream. A record still cut off is counted as skipped.
+     */
+    void finish();
+
+    const DecodedTelemetry& result() const { return out; }
+};
+
+/**
+ * @brief The searches for the next sentinel the decoder picks from, for test/test_decoder to hold against each other.
+ * Each returns the first "##" and record ID at or after begin. If there is none, where a sentinel cut off by end could
+ * start ("#" or "##" as the last bytes), or end.
+ */
+namespace sentinel_search {
+    const uint8_t* scalar(const uint8_t* begin, const uint8_t* end);
+#if defined(__SSE2__)
+    const uint8_t* sse2(const uint8_t* begin, const uint8_t* end);
+    // Only on a CPU with AVX2, see avx2_supported()
+    const uint8_t* avx2(const uint8_t* begin, const uint8_t* end);
+    bool avx2_supported();
+#endif
+}
+
+/**
+ * @brief Feeds a whole capture file, or everything a serial port or pipe sends until it closes, to decoder and calls
+ * finish(). Regular files are memory mapped.
+ * @return false with errno set if path could not be opened or read
+ */
+bool decodeFile(const char* path, TelemetryDecoder& decoder);
+
+/**
+ * @brief Writes one CSV file per record kind, prefix + "S.csv", "I.csv", "T.csv", "J.csv" and "H.csv", one row per record.
+ * @return false with errno set if a file could not be written
+ */
+bool writeCsv(const DecodedTelemetry& telemetry, const char* prefix);
+#endif
+#endif
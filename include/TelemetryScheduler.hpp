@@ -0,0 +1,78 @@
+/**
+ * @file TelemetryScheduler.hpp
+ * @brief Fits each cycle's frame to what the UART can send in one sample period: live records first, then as many
+ * replayed records as the rest of the budget holds.
+ *
+ * The budget is the link rate (10 bits a byte on the wire) times the period, less whatever will still be queued on the
+ * UART when the next frame goes out. main.cpp plans the next frame in readData(), once this cycle's sweep is coded and
+ * its size known: begin(), take() the live records, then read and take() replay records from the EEPROM while fits()
+ * says the worst case one still would. So a link that falls behind sheds replay, never live data, and a backlog that
+ * built up (loss of signal, a frame that did not fit) drains as fast as the spare link time allows.
+ *
+ * It also keeps the EEPROM backlog and how fast it is draining, for housekeeping.
+ */
+#ifndef TELEMETRY_SCHEDULER_HPP
+#define TELEMETRY_SCHEDULER_HPP
+#include <stdint.h>
+
+#define UART_BITS_PER_BYTE 10      // start, 8 data, stop
+#define SCHEDULER_DRAIN_SMOOTHING 8  // cycles the drain rate is averaged over, roughly
+
+class TelemetryScheduler {
+private:
+    uint32_t bytes_per_second;
+    uint32_t period_us;
+    int32_t left;              // budget left for the frame being planned, negative if live data alone overran it
+    uint32_t backlog;          // EEPROM bytes waiting to be replayed, at the last begin()
+    uint32_t backlog_us;       // when it was measured
+    bool measured;
+    int32_t drain_sum;         // backlog drained per second, SCHEDULER_DRAIN_SMOOTHING times over. Negative while it grows.
+    uint32_t replayed;         // replay records scheduled since start up
+
+public:
+    /**
+     * @param baud UART baud rate
+     * @param period_us cycle length, SAMPLE_PERIOD
+     */
+    TelemetryScheduler(uint32_t baud, uint32_t period_us);
+
+    /**
+     * @brief Starts planning the frame the next cycle sends.
+     * @param pending bytes still queued on the UART (PDC::pending_bytes())
+     * @param elapsed_us time since this cycle started
+     * @param backlog EEPROM bytes waiting to be replayed (AT25M02::usedBytes())
+     * @param now_us hal::micros()
+     */
+    void begin(uint32_t pending, uint32_t elapsed_us, uint32_t backlog, uint32_t now_us);
+
+    /**
+     * @brief Whether bytes more still fit in the frame.
+     */
+    bool fits(uint32_t bytes) const { return left >= (int32_t)bytes; }
+
+    /**
+     * @brief Adds bytes to the frame, whether they fit or not (live records always go).
+     */
+    void take(uint32_t bytes){ left -= (int32_t)bytes; }
+
+    /**
+     * @brief take() for a replay record.
+     */
+    void replay(uint32_t bytes){
+        take(bytes);
+        replayed++;
+    }
+
+    /**
+     * @brief Bytes the link carries in one period.
+     */
+    uint32_t budget() const { return (uint32_t)((uint64_t)bytes_per_second * period_us / 1000000); }
+    int32_t remaining() const { return left; }
+    uint32_t get_backlog() const { return backlog; }
+    /**
+     * @brief Backlog bytes drained per second, averaged over the last few cycles. Negative while the backlog grows.
+     */
+    int32_t get_drain_rate() const { return drain_sum / SCHEDULER_DRAIN_SMOOTHING; }
+    uint32_t get_replayed() const { return replayed; }
+};
+#endif
@@ -9,9 +9,8 @@
  * at some point.
  */
 
-#include <Arduino.h>
-#include <SPI.h>
 #include <AT25M02.hpp>
+#include <Counters.hpp>
 
 // Define chip select. MO,MI,SLK all are default values.
 #define CHIP_SELECT_PIN 4
@@ -23,6 +22,20 @@
 #define PAGE_LEN 256
 const uint32_t RAM_SIZE = (1L << 18);
 #define NUM_PAGES (RAM_SIZE / PAGE_LEN)
+#define WRITE_BUFFER_LEN (AT25M02_WRITE_PAGES * PAGE_LEN)
+#define READ_BUFFER_LEN (AT25M02_READ_PAGES * PAGE_LEN)
+static_assert(RAM_SIZE % PAGE_LEN == 0, "pages must not straddle the end of the array");
+static_assert(AT25M02_WRITE_PAGES >= 2, "one page has to be able to wait for the chip while the next one fills");
+static_assert((AT25M02_WRITE_PAGES & (AT25M02_WRITE_PAGES - 1)) == 0,
+              "wb_start and wb_end wrap at 2^32, so the ring has to divide it");
+static_assert(AT25M02_READ_PAGES >= 1 && (AT25M02_READ_PAGES & (AT25M02_READ_PAGES - 1)) == 0,
+              "rb_start and rb_end wrap at 2^32 too");
+
+// Arduino's min() is a macro on the Due and absent on the host.
+static inline uint32_t umin(uint32_t a, uint32_t b)
+{
+	return a < b ? a : b;
+}
 
 /* // Constructor
 
@@ -38,19 +51,59 @@ AT25M02::AT25M02()
  */
 void AT25M02::init(){
 	// Set up SPI device settings
-	spi_settings = SPISettings(SPI_DATA_RATE, MSBFIRST, SPI_MODE0);
+	spi_settings = hal::SpiSettings(SPI_DATA_RATE, MSBFIRST, SPI_MODE0);
 	// Set pin out information. Could be passed in via constructor params.
 	chip_select_pin = CHIP_SELECT_PIN;
-	pinMode(chip_select_pin, OUTPUT);
+	hal::pin_mode(chip_select_pin, OUTPUT);
+	transport = EepromTransport::GPIO_CS;
+	transferring = false;
 	mem_start = 0;
 	mem_end = 0;
 	ram_full = false;
+	wb_start = 0;
 	wb_end = 0;
+	rb_start = 0;
+	rb_end = 0;
+	fetching = 0;
 	setWRSR(0x00);
+	// Writing the status register starts a write cycle too
+	writing = true;
+}
+
+/**
+ * @brief Chooses how the chip is reached. HW_CS_DMA hands the chip select pin to the
+ * SPI peripheral, 8-bit frames, GPIO_CS takes it back.
+ */
+void AT25M02::set_transport(EepromTransport t)
+{
+	waitForTransfer();
+#if !AT25M02_DMA
+	t = EepromTransport::GPIO_CS;
+#endif
+	transport = t;
+	if (t == EepromTransport::HW_CS_DMA) {
+		hal::spi_hw_cs_begin(chip_select_pin, spi_settings, 8);
+	} else {
+		hal::pin_mode(chip_select_pin, OUTPUT);
+		hal::digital_write(chip_select_pin, HIGH);
+	}
+}
+
+/**
+ * @brief The page program started by writePage() is on the chip, or the READ started
+ * by prefetch() is in dma.rx. Only the bus is free: the chip may be in its write
+ * cycle, see poll(), and collect() moves the read-ahead.
+ */
+void AT25M02::DMAC_Handler()
+{
+	hal::spi_dma_ack();
+	transferring = false;
 }
 
 /** 
  * @brief Returns how many bytes are free and available to be written to.
+ * A full page in the write buffer always fits: the chip then has at least a page
+ * free, from mem_end, which is page aligned.
  */
 uint32_t AT25M02::freeBytes()
 {
@@ -62,15 +115,21 @@ uint32_t AT25M02::freeBytes()
  */
 uint32_t AT25M02::usedBytes()
 {
-	return usedMemoryBytes() + usedBufferBytes();
+	return usedCacheBytes() + usedMemoryBytes() + usedBufferBytes();
 }
 
+/*
+ * mem_start and mem_end are both in [0, RAM_SIZE), so equal pointers are either
+ * an empty or a full chip. ram_full says which.
+ */
 uint32_t AT25M02::usedMemoryBytes()
 {
-	if (mem_end >= mem_start) {
+	if (mem_end > mem_start) {
 		return mem_end - mem_start;
-	} else {
+	} else if (mem_end < mem_start) {
 		return (RAM_SIZE - mem_start) + mem_end;
+	} else {
+		return ram_full ? RAM_SIZE : 0;
 	}
 }
 
@@ -81,12 +140,22 @@ uint32_t AT25M02::freeMemoryBytes()
 
 uint32_t AT25M02::usedBufferBytes()
 {
-	return wb_end;
+	return wb_end - wb_start;
 }
 
 uint32_t AT25M02::freeBufferBytes()
 {
-	return PAGE_LEN - wb_end;
+	return WRITE_BUFFER_LEN - usedBufferBytes();
+}
+
+uint32_t AT25M02::usedCacheBytes()
+{
+	return rb_end - rb_start;
+}
+
+uint32_t AT25M02::freeCacheBytes()
+{
+	return READ_BUFFER_LEN - usedCacheBytes();
 }
 
 
@@ -94,91 +163,259 @@ uint32_t AT25M02::freeBufferBytes()
  * @brief Write from the given array to the memory. This data is appended to the end of
  * the queue. Returns true if it successfully wrote all bytes. Returns false if
  * it could not write every byte without overwriting existing data.
+ * Both are counted in the housekeeping counters, with the bytes now in use.
+ * The bytes go into the write buffer and full pages are programmed by poll(), so
+ * this only waits for the chip if every buffered page is still waiting.
  */
 bool AT25M02::writeData(byte* bytes, uint32_t length)
 {
 	// Bail out if we don't have enough space
-	if (length > freeBytes() || ram_full) {
+	if (length > freeBytes()) {
+		counters::add(COUNTER_EEPROM_REJECTED);
+		return false;
+	}
+	appendWriteBuffer(bytes, length);
+	program();
+	counters::add(COUNTER_EEPROM_WRITTEN, length);
+	counters::set(COUNTER_EEPROM_USED, usedBytes());
+	return true;
+}
+
+/**
+ * @brief Vectored writeData(): the segments are stored back to back as one record.
+ * The space check covers the whole record, so a full EEPROM rejects all of it rather
+ * than keeping the first segments, and the page program (and status read) is started
+ * once per record instead of once per segment.
+ */
+bool AT25M02::writeData(const TxSegment* segments, size_t count)
+{
+	uint32_t length = 0;
+	for (size_t i = 0; i < count; i++)
+		length += segments[i].length;
+	if (length > freeBytes()) {
+		counters::add(COUNTER_EEPROM_REJECTED);
 		return false;
-	} else if (length == freeBytes()) {
-		ram_full = true;
 	}
-	// Loop over in the input and move it first to the buffer, and then to
-	// the RAM chip when the write buffer is full.
+	for (size_t i = 0; i < count; i++)
+		appendWriteBuffer((const byte *) segments[i].data, segments[i].length);
+	program();
+	counters::add(COUNTER_EEPROM_WRITTEN, length);
+	counters::set(COUNTER_EEPROM_USED, usedBytes());
+	return true;
+}
+
+/*
+ * Copies bytes to the end of the write buffer, up to the end of the ring at a time.
+ * The caller has checked they fit in the queue. When the ring is full a page is
+ * programmed, after waiting for the write cycle if the chip is still busy.
+ */
+void AT25M02::appendWriteBuffer(const byte *bytes, uint32_t length)
+{
 	uint32_t buf_len;
-	for(;;) {
-		// Move to bytes to write buffer.
-		buf_len = min(length, freeBufferBytes());
-		//copies given buffer into write buffer
-		//write buffer is 256 byte array
-		memcpy(write_buffer + wb_end, bytes, buf_len);
+	while (length > 0) {
+		if (freeBufferBytes() == 0) {
+			// A record can fill the last page before writeData() gets
+			// to program(), so try it first.
+			program();
+			if (freeBufferBytes() == 0) {
+				// Every page is waiting for the chip, so this one has to.
+				counters::add(COUNTER_EEPROM_STALLS);
+				waitUntilReady();
+				writing = false;
+				program();
+			}
+			continue;
+		}
+		uint32_t at = wb_end % WRITE_BUFFER_LEN;
+		buf_len = umin(umin(length, freeBufferBytes()), WRITE_BUFFER_LEN - at);
+		memcpy(write_buffer + at, bytes, buf_len);
 		wb_end += buf_len;
 		bytes  += buf_len;
 		length -= buf_len;
-		// Break when write buffer is not full.
-		// Breaking means the input buffer is exhausted.
-		if (wb_end != PAGE_LEN) break;
-		// Write to page.
-		// Will be slow when writing multiple pages at once.
-		waitUntilReady();
-		writePage(mem_end, write_buffer, PAGE_LEN);
-		wb_end = 0;
 	}
-	return true;
 }
 
 uint32_t AT25M02::readWriteBuffer(byte *dest, uint32_t length)
 {
-	uint32_t len = min(length, usedBufferBytes());
+	uint32_t len = umin(length, usedBufferBytes());
 	if (len == 0)
 		return len;
-	memcpy(dest, write_buffer, len);
-	memmove(write_buffer, write_buffer + len, usedBufferBytes() - len);
-	wb_end -= len;
+	uint32_t at = wb_start % WRITE_BUFFER_LEN;
+	uint32_t first = umin(len, WRITE_BUFFER_LEN - at);
+	memcpy(dest, write_buffer + at, first);
+	memcpy(dest + first, write_buffer, len - first);
+	wb_start += len;
 	return len;
 }
 
+uint32_t AT25M02::readCache(byte *dest, uint32_t length)
+{
+	uint32_t len = umin(length, usedCacheBytes());
+	if (len == 0)
+		return len;
+	uint32_t at = rb_start % READ_BUFFER_LEN;
+	uint32_t first = umin(len, READ_BUFFER_LEN - at);
+	memcpy(dest, read_buffer + at, first);
+	memcpy(dest + first, read_buffer, len - first);
+	rb_start += len;
+	return len;
+}
+
+/*
+ * Reads from mem_start, in two READ commands if the data runs past the end of the
+ * array, rather than counting on the chip's address rolling over.
+ */
 uint32_t AT25M02::readMemory(byte *dest, uint32_t length)
 {
-	uint32_t len = min(length, usedMemoryBytes());
+	uint32_t len = umin(length, usedMemoryBytes());
 	if (len == 0)
 		return len;
 	waitUntilReady();
+	writing = false;
 
+	uint32_t first = umin(len, RAM_SIZE - mem_start);
+	readAt(mem_start, dest, first);
+	if (first < len)
+		readAt(0, dest + first, len - first);
+	mem_start = (mem_start + len) % RAM_SIZE;
+	ram_full = false;
+	return len;
+}
+
+/*
+ * One READ command of length bytes from addr. The chip must be ready.
+ * Over DMA it is one READ a page at a time, the size of the DMA buffers.
+ */
+void AT25M02::readAt(uint32_t addr, byte *dest, uint32_t length)
+{
+#if AT25M02_DMA
+	if (transport == EepromTransport::HW_CS_DMA) {
+		while (length > 0) {
+			uint32_t len = umin(length, PAGE_LEN);
+			startRead(addr, len);
+			waitForTransfer();
+			for (uint32_t i = 0; i < len; i++)
+				dest[i] = (byte) dma.rx[4 + i];
+			addr   += len;
+			dest   += len;
+			length -= len;
+		}
+		return;
+	}
+#endif
 	// Have to pull out each byte to give to the RAM one at a time
-	byte addr_byte2 = (byte) ((mem_start >> 16) & 0xFF);
-	byte addr_byte1 = (byte) ((mem_start >> 8)  & 0xFF);
-	byte addr_byte0 = (byte) (mem_start         & 0xFF);
+	byte addr_byte2 = (byte) ((addr >> 16) & 0xFF);
+	byte addr_byte1 = (byte) ((addr >> 8)  & 0xFF);
+	byte addr_byte0 = (byte) (addr         & 0xFF);
 
-	SPI.beginTransaction(spi_settings);
+	hal::spi_begin_transaction(spi_settings);
 	csl();
-	SPI.transfer(READ);
-	SPI.transfer(addr_byte2);
-	SPI.transfer(addr_byte1);
-	SPI.transfer(addr_byte0);
-	SPI.transfer(dest, len);
+	hal::spi_transfer(READ);
+	hal::spi_transfer(addr_byte2);
+	hal::spi_transfer(addr_byte1);
+	hal::spi_transfer(addr_byte0);
+	hal::spi_transfer(dest, length);
 	csh();
-	SPI.endTransaction();
-	mem_start += len;
-	ram_full = false;
+	hal::spi_end_transaction();
+}
+
+#if AT25M02_DMA
+/*
+ * Starts a READ of length bytes (at most a page) from addr as a DMA transfer. The
+ * data lands in dma.rx after the command and address frames.
+ */
+void AT25M02::startRead(uint32_t addr, uint32_t length)
+{
+	waitForTransfer();
+	uint32_t word = hal::spi_tdr(chip_select_pin, 0, false);
+	dma.tx[0] = word | READ;
+	dma.tx[1] = word | ((addr >> 16) & 0xFF);
+	dma.tx[2] = word | ((addr >> 8)  & 0xFF);
+	dma.tx[3] = word | (addr         & 0xFF);
+	for (uint32_t i = 0; i < length; i++)
+		dma.tx[4 + i] = word;
+	dma.tx[3 + length] = hal::spi_tdr(chip_select_pin, 0, true);
+	transferring = true;
+	hal::spi_dma_start(dma.tx, dma.rx, 4 + length);
+}
+#endif
+
+/*
+ * How much prefetch() would read: the rest of mem_start's page, if the chip has it and
+ * it fits, otherwise 0. mem_end is page aligned, so the chip holds at least that much
+ * if it holds anything, and after the first read-ahead they are whole pages.
+ */
+uint32_t AT25M02::prefetchLength()
+{
+	uint32_t len = PAGE_LEN - mem_start % PAGE_LEN;
+	if (usedMemoryBytes() < len || freeCacheBytes() < len)
+		return 0;
 	return len;
 }
 
+/*
+ * Reads prefetchLength() bytes into the read-ahead buffer. The chip must be ready.
+ */
+void AT25M02::prefetch()
+{
+	uint32_t len = prefetchLength();
+	if (len == 0)
+		return;
+#if AT25M02_DMA
+	if (transport == EepromTransport::HW_CS_DMA) {
+		startRead(mem_start, len);
+		fetching = len;
+		hal::spi_dma_notify();
+		return;
+	}
+#endif
+	uint32_t at = rb_end % READ_BUFFER_LEN;
+	uint32_t first = umin(len, READ_BUFFER_LEN - at);
+	readAt(mem_start, read_buffer + at, first);
+	if (first < len)
+		readAt(mem_start + first, read_buffer, len - first);
+	rb_end += len;
+	mem_start = (mem_start + len) % RAM_SIZE;
+	ram_full = false;
+}
+
+/*
+ * The bytes of a finished read-ahead leave the chip side of the queue for the
+ * read-ahead buffer.
+ */
+void AT25M02::collect()
+{
+	if (fetching == 0 || transferring)
+		return;
+#if AT25M02_DMA
+	for (uint32_t i = 0; i < fetching; i++)
+		read_buffer[(rb_end + i) % READ_BUFFER_LEN] = (byte) dma.rx[4 + i];
+#endif
+	rb_end += fetching;
+	mem_start = (mem_start + fetching) % RAM_SIZE;
+	ram_full = false;
+	fetching = 0;
+}
+
 /**
  * @brief Write the given number of bytes from the ram into the destination array.
  * These bytes are taken from the start of the queue.
  * Returns how many bytes were read and written to the array.
+ * The oldest bytes are in the read-ahead buffer, so usually this is a memcpy. Only
+ * what poll() has not read ahead yet costs a READ here.
  */
 int AT25M02::readData(byte* dest, uint32_t length)
 {
-	uint32_t memlen = readMemory(dest, length);
-	uint32_t buflen = 0;
-	if (memlen < length) {
-		dest += memlen;
-		length -= memlen;
-		buflen = readWriteBuffer(dest, length);
+	collect();
+	uint32_t got = readCache(dest, length);
+	if (got < length) {
+		// A read-ahead still on the bus holds the next bytes
+		waitForTransfer();
+		got += readCache(dest + got, length - got);
+		got += readMemory(dest + got, length - got);
+		got += readWriteBuffer(dest + got, length - got);
 	}
-	return memlen + buflen;
+	return got;
 }
 
 /**
@@ -186,24 +423,64 @@ int AT25M02::readData(byte* dest, uint32_t length)
  */
 bool AT25M02::isReady()
 {
-	bool ready;
-	SPI.beginTransaction(spi_settings);
-	csl();
-	SPI.transfer(READ_STATUS);
+	select();
+	transfer(READ_STATUS);
 	// Bit 0 of READ_STATUS response is 0 when the device is ready
-	ready = (SPI.transfer(0) & 0x01) == 0;
-	csh();
-	SPI.endTransaction();
-	return ready;
+	return (transfer(0, true) & 0x01) == 0;
+}
+
+/**
+ * @brief Starts programming the oldest full page in the write buffer, if the chip
+ * is done with the last one. With no page waiting, reads the next page ahead instead.
+ * Never waits: the status is read once, and only while a write cycle may still be
+ * running.
+ * Returns true while full pages are still waiting.
+ */
+bool AT25M02::poll()
+{
+	collect();
+	if (usedBufferBytes() >= PAGE_LEN)
+		return program();
+	if (transferring || prefetchLength() == 0)
+		return false;
+	if (writing) {
+		if (!isReady())
+			return false;
+		writing = false;
+	}
+	prefetch();
+	return false;
+}
+
+/*
+ * poll() without the read-ahead, for writeData(): programs the oldest full page if
+ * the bus and the chip are free. Returns true while full pages are still waiting.
+ */
+bool AT25M02::program()
+{
+	if (usedBufferBytes() < PAGE_LEN)
+		return false;
+	// The last page or read-ahead is still on the bus
+	if (transferring)
+		return true;
+	if (writing && !isReady())
+		return true;
+	writePage(mem_end);
+	writing = true;
+	return usedBufferBytes() >= PAGE_LEN;
 }
 
 // Private Methods
 
 /**
- * @brief Write the given data to the RAM in a page write.
- * Increments mem_end when done.
+ * @brief Write the page at the front of the write buffer to the RAM in a page write.
+ * Moves mem_end on a page, wrapping at the end of the array, and the buffer start
+ * with it when done. addr is always page aligned, so the page never rolls over. The chip is busy
+ * for its write cycle after this, see poll().
+ * Over DMA the page is copied into the transfer, so the buffer space is free as soon
+ * as it has started, and this returns while the page is still on the bus.
  */
-void AT25M02::writePage(uint32_t addr, byte* bytes, uint32_t length)
+void AT25M02::writePage(uint32_t addr)
 {
 	// Have to pull out each byte to give to the RAM one at a time
 	byte addr_byte2 = (byte) ((addr >> 16) & 0xFF);
@@ -211,26 +488,84 @@ void AT25M02::writePage(uint32_t addr, byte* bytes, uint32_t length)
 	byte addr_byte0 = (byte) (addr         & 0xFF);
 	// Enable writing
 	sendCommand(WRITE_ENABLE);
-	// Write everything over SPI
-	SPI.beginTransaction(spi_settings);
+	// The page may run past the end of the ring.
+	uint32_t at = wb_start % WRITE_BUFFER_LEN;
+	uint32_t first = umin(PAGE_LEN, WRITE_BUFFER_LEN - at);
+#if AT25M02_DMA
+	if (transport == EepromTransport::HW_CS_DMA) {
+		uint32_t word = hal::spi_tdr(chip_select_pin, 0, false);
+		dma.tx[0] = word | WRITE_PAGE;
+		dma.tx[1] = word | addr_byte2;
+		dma.tx[2] = word | addr_byte1;
+		dma.tx[3] = word | addr_byte0;
+		for (uint32_t i = 0; i < first; i++)
+			dma.tx[4 + i] = word | write_buffer[at + i];
+		for (uint32_t i = first; i < PAGE_LEN; i++)
+			dma.tx[4 + i] = word | write_buffer[i - first];
+		dma.tx[3 + PAGE_LEN] = hal::spi_tdr(chip_select_pin, dma.tx[3 + PAGE_LEN] & 0xFF, true);
+		transferring = true;
+		hal::spi_dma_start(dma.tx, dma.rx, 4 + PAGE_LEN);
+		hal::spi_dma_notify();
+	}
+#endif
+	if (transport == EepromTransport::GPIO_CS) {
+		// Write everything over SPI
+		hal::spi_begin_transaction(spi_settings);
+		csl();
+		hal::spi_transfer(WRITE_PAGE);
+		hal::spi_transfer(addr_byte2);
+		hal::spi_transfer(addr_byte1);
+		hal::spi_transfer(addr_byte0);
+		// The SPI exchange overwrites the page with MISO, which is fine, it is
+		// not needed after this.
+		hal::spi_transfer(write_buffer + at, first);
+		if (first < PAGE_LEN)
+			hal::spi_transfer(write_buffer, PAGE_LEN - first);
+		csh();
+		hal::spi_end_transaction();
+	}
+	wb_start += PAGE_LEN;
+	mem_end = (mem_end + PAGE_LEN) % RAM_SIZE;
+	if (mem_end == mem_start)
+		ram_full = true;
+}
+
+
+/*
+ * Starts a command. Over DMA the peripheral drives chip select, so this only
+ * waits for the bus.
+ */
+void AT25M02::select()
+{
+	if (transport == EepromTransport::HW_CS_DMA) {
+		waitForTransfer();
+		return;
+	}
+	hal::spi_begin_transaction(spi_settings);
 	csl();
-	SPI.transfer(WRITE_PAGE);
-	SPI.transfer(addr_byte2);
-	SPI.transfer(addr_byte1);
-	SPI.transfer(addr_byte0);
-	SPI.transfer(bytes, length);
-	csh();
-	SPI.endTransaction();
-	mem_end += min(PAGE_LEN, length) % RAM_SIZE;
 }
 
+/*
+ * One byte of a command started by select(). last raises chip select after it.
+ */
+byte AT25M02::transfer(byte data, bool last)
+{
+	if (transport == EepromTransport::HW_CS_DMA)
+		return (byte) hal::spi_frame(hal::spi_tdr(chip_select_pin, data, last));
+	byte ret = hal::spi_transfer(data);
+	if (last) {
+		csh();
+		hal::spi_end_transaction();
+	}
+	return ret;
+}
 
 /*
  * Set chip select low
  */
 void AT25M02::csl()
 {
-	digitalWrite(CHIP_SELECT_PIN, LOW);
+	hal::digital_write(CHIP_SELECT_PIN, LOW);
 }
 
 /*
@@ -238,20 +573,15 @@ void AT25M02::csl()
  */
 void AT25M02::csh()
 {
-	digitalWrite(CHIP_SELECT_PIN, HIGH);
+	hal::digital_write(CHIP_SELECT_PIN, HIGH);
 }
 
 
 byte AT25M02::readStatusReg()
 {
-	byte ret;
-	SPI.beginTransaction(spi_settings);
-	csl();
-	SPI.transfer(READ_STATUS);
-	ret = SPI.transfer(0);
-	csh();
-	SPI.endTransaction();
-	return ret;
+	select();
+	transfer(READ_STATUS);
+	return transfer(0, true);
 }
 
 /*
@@ -259,11 +589,8 @@ byte AT25M02::readStatusReg()
  */
 void AT25M02::sendCommand(Command cmd)
 {
-	SPI.beginTransaction(spi_settings);
-	csl();
-	SPI.transfer(cmd);
-	csh();
-	SPI.endTransaction();
+	select();
+	transfer(cmd, true);
 }
 
 /**
@@ -273,14 +600,11 @@ void AT25M02::setWRSR(byte val)
 {
 	sendCommand(WRITE_ENABLE);
 	waitUntilReady();
-	SPI.beginTransaction(spi_settings);
-	csl();
-	SPI.transfer(0x01);
-	SPI.transfer(val);
-	SPI.transfer(READ_STATUS);
-	volatile byte status = SPI.transfer(0);
-	csh();
-	SPI.endTransaction();
+	select();
+	transfer(0x01);
+	transfer(val);
+	transfer(READ_STATUS);
+	volatile byte status = transfer(0, true);
 }
 
 /**
@@ -289,16 +613,27 @@ void AT25M02::setWRSR(byte val)
 void AT25M02::waitUntilReady()
 {
 	// TODO: Guard timing w/ DEBUG macro
-	// int startt = micros();
-	SPI.beginTransaction(spi_settings);
-	csl();
-	do {
-		SPI.transfer(READ_STATUS);
-	} while ((SPI.transfer(0) & 0x01) != 0);
-	csh();
-	SPI.endTransaction();
-	// int endt = micros();
+	// int startt = hal::micros();
+	// A status read per command: the peripheral only raises chip select on a
+	// frame it already knows is the last.
+	while (!isReady())
+		;
+	// int endt = hal::micros();
 	// char buf[100];
 	// sprintf(buf, "\nwait until ready blocked time %d\n", endt - startt);
 	// Serial.write(buf);
-}
\ No newline at end of file
+}
+
+/*
+ * Waits for the DMA transfer of ours on the bus, if any, and takes in a read-ahead
+ * before dma.rx is used again.
+ */
+void AT25M02::waitForTransfer()
+{
+	if (transferring) {
+		while (hal::spi_dma_busy())
+			;
+		transferring = false;
+	}
+	collect();
+}
@@ -0,0 +1,22 @@
+/**
+ * @file Counters.cpp
+ * @brief The housekeeping counter table. See Counters.hpp.
+ */
+#include <Counters.hpp>
+
+namespace counters {
+    volatile uint32_t values[NUM_COUNTERS];
+
+#ifndef ARDUINO
+    const char* name(Counter counter){
+        static const char* const NAMES[] = {
+            "uart_frames", "uart_bytes", "uart_rejected", "uart_sent", "pdc_max_depth",
+            "eeprom_written", "eeprom_rejected", "eeprom_used", "eeprom_stalls",
+            "timer_cycles", "missed_cycles", "sync_pulses", "fsm_interrupts",
+            "fec_max_cycles", "coding_max_cycles"
+        };
+        static_assert(sizeof(NAMES) / sizeof(NAMES[0]) == NUM_COUNTERS, "one name per counter");
+        return counter < NUM_COUNTERS ? NAMES[counter] : "unknown";
+    }
+#endif
+}
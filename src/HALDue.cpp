@@ -0,0 +1,133 @@
+/**
+ * @file HALDue.cpp
+ * @brief Due implementations of the HAL functions that are too big to inline in HAL.hpp.
+ *
+ * Only compiled when ARDUINO is defined.
+ */
+#ifdef ARDUINO
+#include <HAL.hpp>
+
+// DMAC channels and hardware handshaking interfaces for SPI0 (SAM3X datasheet, DMAC channel definition table).
+// SPI0 has no PDC on the SAM3X, DMA goes through the DMAC instead.
+#define SPI_DMAC_TX_CH 0
+#define SPI_DMAC_RX_CH 1
+#define SPI_DMAC_TX_PER 1
+#define SPI_DMAC_RX_PER 2
+
+// SRAM vector table: the 16 Cortex-M3 exception vectors, then one per peripheral. VTOR needs it aligned to its size
+// rounded up to a power of two, 64 words.
+#define VECTOR_COUNT (16 + PERIPH_COUNT_IRQn)
+#define VECTOR_TABLE_ALIGN 256
+
+namespace hal {
+void spi_hw_cs_begin(uint32_t pin, const SpiSettings& settings, uint8_t bits){
+    // Mux the pin to its NPCS line and set up that chip select's clock/mode. The library sets CSAAT, so chip select
+    // stays low between frames until a frame tagged LASTXFER.
+    SPI.begin(pin);
+    SPI.beginTransaction(pin, settings);
+    SPI.endTransaction();
+    uint32_t ch = BOARD_PIN_TO_SPI_CHANNEL(pin);
+    SPI0->SPI_CSR[ch] = (SPI0->SPI_CSR[ch] & ~SPI_CSR_BITS_Msk) | (((uint32_t)bits - 8) << SPI_CSR_BITS_Pos);
+
+    pmc_enable_periph_clk(ID_DMAC);
+    DMAC->DMAC_EN &= ~DMAC_EN_ENABLE;
+    DMAC->DMAC_GCFG = DMAC_GCFG_ARB_CFG_FIXED;
+    DMAC->DMAC_EN = DMAC_EN_ENABLE;
+}
+
+void uart_attach_interrupt(void (*handler)()){
+    static uint32_t vectors[VECTOR_COUNT] __attribute__((aligned(VECTOR_TABLE_ALIGN)));
+    static_assert(VECTOR_COUNT * sizeof(uint32_t) <= VECTOR_TABLE_ALIGN, "vector table alignment too small");
+    IrqState irq = irq_save();
+    if (SCB->VTOR != (uint32_t)vectors){
+        // Everything else keeps the core's handler
+        memcpy(vectors, (const void*)SCB->VTOR, sizeof(vectors));
+        SCB->VTOR = (uint32_t)vectors;
+    }
+    vectors[16 + UART_IRQn] = (uint32_t)handler;
+    __DSB();
+    irq_restore(irq);
+}
+
+void spi_dma_start(const uint32_t* tx, uint16_t* rx, size_t count){
+    DMAC->DMAC_CHDR = (DMAC_CHDR_DIS0 << SPI_DMAC_RX_CH) | (DMAC_CHDR_DIS0 << SPI_DMAC_TX_CH);
+    // No completion interrupt unless spi_dma_notify() asks again, and none left over from the last transfer
+    DMAC->DMAC_EBCIDR = DMAC_EBCIDR_BTC0 << SPI_DMAC_RX_CH;
+    (void)DMAC->DMAC_EBCISR;
+    // Drop anything left in RDR so the first received frame lines up with the first transmitted one
+    (void)SPI0->SPI_RDR;
+
+    DmacCh_num* ch = &DMAC->DMAC_CH_NUM[SPI_DMAC_RX_CH];
+    ch->DMAC_SADDR = (uint32_t)&SPI0->SPI_RDR;
+    ch->DMAC_DADDR = (uint32_t)rx;
+    ch->DMAC_DSCR = 0;
+    ch->DMAC_CTRLA = count | DMAC_CTRLA_SRC_WIDTH_HALF_WORD | DMAC_CTRLA_DST_WIDTH_HALF_WORD;
+    ch->DMAC_CTRLB = DMAC_CTRLB_SRC_DSCR | DMAC_CTRLB_DST_DSCR | DMAC_CTRLB_FC_PER2MEM_DMA_FC |
+                     DMAC_CTRLB_SRC_INCR_FIXED | DMAC_CTRLB_DST_INCR_INCREMENTING;
+    ch->DMAC_CFG = DMAC_CFG_SRC_PER(SPI_DMAC_RX_PER) | DMAC_CFG_SRC_H2SEL | DMAC_CFG_SOD | DMAC_CFG_FIFOCFG_ASAP_CFG;
+
+    ch = &DMAC->DMAC_CH_NUM[SPI_DMAC_TX_CH];
+    ch->DMAC_SADDR = (uint32_t)tx;
+    ch->DMAC_DADDR = (uint32_t)&SPI0->SPI_TDR;
+    ch->DMAC_DSCR = 0;
+    ch->DMAC_CTRLA = count | DMAC_CTRLA_SRC_WIDTH_WORD | DMAC_CTRLA_DST_WIDTH_WORD;
+    ch->DMAC_CTRLB = DMAC_CTRLB_SRC_DSCR | DMAC_CTRLB_DST_DSCR | DMAC_CTRLB_FC_MEM2PER_DMA_FC |
+                     DMAC_CTRLB_SRC_INCR_INCREMENTING | DMAC_CTRLB_DST_INCR_FIXED;
+    ch->DMAC_CFG = DMAC_CFG_DST_PER(SPI_DMAC_TX_PER) | DMAC_CFG_DST_H2SEL | DMAC_CFG_SOD | DMAC_CFG_FIFOCFG_ALAP_CFG;
+
+    DMAC->DMAC_CHER = (DMAC_CHER_ENA0 << SPI_DMAC_RX_CH) | (DMAC_CHER_ENA0 << SPI_DMAC_TX_CH);
+}
+
+bool spi_dma_busy(){
+    return DMAC->DMAC_CHSR & (DMAC_CHSR_ENA0 << SPI_DMAC_RX_CH);
+}
+
+void spi_dma_notify(){
+    // Buffer transfer complete on the receive channel: the last frame is in memory and chip select is back up.
+    // If it already is, the interrupt is raised straight away.
+    DMAC->DMAC_EBCIER = DMAC_EBCIER_BTC0 << SPI_DMAC_RX_CH;
+    NVIC_EnableIRQ(DMAC_IRQn);
+}
+
+void spi_dma_ack(){
+    DMAC->DMAC_EBCIDR = DMAC_EBCIDR_BTC0 << SPI_DMAC_RX_CH;
+    (void)DMAC->DMAC_EBCISR;
+}
+
+void dac_sweep_start(const uint32_t* words, size_t count, uint32_t trigger_ticks){
+    // TC0 channels 1 and 2 have their own peripheral clocks
+    pmc_enable_periph_clk(ID_TC1);
+    pmc_enable_periph_clk(ID_TC2);
+
+    DACC->DACC_PTCR = DACC_PTCR_TXTDIS;
+    // Trigger on TIOA1, two tagged half-words per word. Refresh and startup stay as analogWrite set them up.
+    DACC->DACC_MR = (DACC->DACC_MR & ~(DACC_MR_TRGSEL_Msk | DACC_MR_USER_SEL_Msk)) |
+                    DACC_MR_TRGEN_EN | DACC_MR_TRGSEL(2) | DACC_MR_WORD_WORD | DACC_MR_TAG_EN;
+    DACC->DACC_CHER = DACC_CHER_CH0 | DACC_CHER_CH1;
+
+    // TIOA1 rises at RA every period - one DACC trigger per period
+    TC_Configure(TC0, 1, TC_CMR_WAVE | TC_CMR_WAVSEL_UP_RC | TC_CMR_TCCLKS_TIMER_CLOCK1 |
+                         TC_CMR_ACPA_SET | TC_CMR_ACPC_CLEAR);
+    TC_SetRA(TC0, 1, trigger_ticks / 2);
+    TC_SetRC(TC0, 1, trigger_ticks - 1);
+    // Free running count of the same clock, for scheduling relative to the step edges
+    TC_Configure(TC0, 2, TC_CMR_TCCLKS_TIMER_CLOCK1);
+
+    // The PDC fills the DACC FIFO now, conversions wait for the triggers
+    DACC->DACC_TPR = (uint32_t)words;
+    DACC->DACC_TCR = count;
+    DACC->DACC_PTCR = DACC_PTCR_TXTEN;
+
+    // Not TC_BCR_SYNC - that would also restart the tick timer on channel 0
+    TC0->TC_CHANNEL[1].TC_CCR = TC_CCR_CLKEN | TC_CCR_SWTRG;
+    TC0->TC_CHANNEL[2].TC_CCR = TC_CCR_CLKEN | TC_CCR_SWTRG;
+}
+
+void dac_sweep_stop(){
+    DACC->DACC_PTCR = DACC_PTCR_TXTDIS;
+    TC_Stop(TC0, 1);
+    TC_Stop(TC0, 2);
+    DACC->DACC_MR &= ~(DACC_MR_TRGEN | DACC_MR_WORD | DACC_MR_TAG);
+}
+}
+#endif
@@ -0,0 +1,846 @@
+/**
+ * @file HALSim.cpp
+ * @brief Host implementation of the HAL against the simulated shield in HALSim.hpp.
+ *
+ * Only compiled when ARDUINO is not defined.
+ */
+#ifndef ARDUINO
+#include <HALSim.hpp>
+#include <math.h>
+#include <queue>
+
+#define NUM_PINS 80
+#define TC0_CLOCK_HZ 656250ULL
+// UART frame is start + 8 data + stop
+#define UART_BITS_PER_BYTE 10ULL
+
+#define TXTEN (1<<8)
+#define TXTDIS (1<<9)
+#define UART_SR_TXRDY (1<<1)
+#define UART_SR_ENDTX (1<<4)
+#define UART_SR_TXEMPTY (1<<9)
+#define UART_SR_TXBUFE (1<<11)
+
+namespace {
+    struct Event {
+        uint64_t at;
+        uint64_t seq;
+        hal::sim::EventFn fn;
+        void* context;
+        // Earliest first, then in scheduling order
+        bool operator>(const Event& other) const {
+            return at != other.at ? at > other.at : seq > other.seq;
+        }
+    };
+
+    struct State {
+        uint64_t now;
+        // GPIO and DAC
+        int pins[NUM_PINS];
+        uint32_t dac[2];
+        hal::sim::SpiDevice* spi_devices[NUM_PINS];
+        hal::sim::SpiDevice* selected;
+        uint32_t selected_pin;
+        bool frame_start;
+        hal::SpiSettings spi_settings;
+        // Chip selects handed to the SPI peripheral by spi_hw_cs_begin, and their settings
+        bool hw_cs[NUM_PINS];
+        hal::SpiSettings hw_cs_settings[NUM_PINS];
+        uint8_t hw_cs_bits[NUM_PINS];
+        uint64_t dma_busy_until;
+        // spi_dma_notify() asked for DMAC_Handler at dma_busy_until
+        bool dma_irq;
+        // Timer triggered DAC sweep
+        bool dacc_running;
+        const uint32_t* dacc_words;
+        size_t dacc_count;
+        uint32_t dacc_trigger_ticks;
+        uint64_t dacc_start;
+        size_t dacc_next;
+        bool trace_enabled;
+        std::vector<hal::sim::SpiTraceEntry> trace;
+        // UART and its PDC channel
+        hal::UartRegs uart;
+        uint32_t baud;
+        uint64_t uart_next_byte;
+        uint64_t uart_bytes;
+        // ENDTX latch: set when TCR reaches zero, even if TNCR reloads it right away. Cleared by writing TCR or TNCR.
+        bool uart_endtx;
+        bool uart_irq;
+        void (*uart_handler)();
+        bool capture_enabled;
+        std::vector<uint8_t> capture;
+        // Interrupts
+        bool masked;
+        bool in_isr;
+        bool tick_enabled;
+        bool tick_pending;
+        uint64_t tick_period;
+        uint64_t tick_next;
+        void (*pin_handlers[NUM_PINS])();
+        uint32_t pin_modes[NUM_PINS];
+        bool pin_pending[NUM_PINS];
+        bool any_pin_pending;
+        // Scheduled events
+        std::priority_queue<Event, std::vector<Event>, std::greater<Event> > events;
+        uint64_t event_seq;
+        // Devices
+        hal::sim::Max1148Model adc;
+        hal::sim::AT25M02Model eeprom;
+
+        State() : now(0), selected(nullptr), selected_pin(0), frame_start(false), dma_busy_until(0),
+                  dma_irq(false),
+                  dacc_running(false), dacc_words(nullptr), dacc_count(0), dacc_trigger_ticks(0), dacc_start(0),
+                  dacc_next(0),
+                  trace_enabled(false), baud(0), uart_next_byte(0), uart_bytes(0), uart_endtx(false), uart_irq(false),
+                  uart_handler(nullptr),
+                  capture_enabled(true), masked(false), in_isr(false), tick_enabled(false), tick_pending(false),
+                  tick_period(0), tick_next(0), any_pin_pending(false), event_seq(0) {
+            for (int i = 0; i < NUM_PINS; i++){
+                pins[i] = HIGH;
+                spi_devices[i] = nullptr;
+                hw_cs[i] = false;
+                hw_cs_bits[i] = 8;
+                pin_handlers[i] = nullptr;
+                pin_modes[i] = 0;
+                pin_pending[i] = false;
+            }
+            dac[0] = dac[1] = 0;
+            // Shield wiring, see main.cpp
+            adc.wire(2, DAC0);
+            adc.wire(1, DAC1);
+            spi_devices[10] = &adc;
+            spi_devices[4] = &eeprom;
+        }
+    };
+
+    State& state(){
+        static State s;
+        return s;
+    }
+
+    uint64_t uart_byte_ns(){
+        State& s = state();
+        return s.baud ? (UART_BITS_PER_BYTE * 1000000000ULL) / s.baud : 0;
+    }
+
+    bool uart_active(){
+        State& s = state();
+        return (s.uart.UART_PTSR.value & TXTEN) && s.uart.UART_TCR.value > 0 && s.baud;
+    }
+
+    /*
+     * Shifts out every byte whose transmission has finished by now and reloads from the next pointer/counter pair.
+     */
+    void uart_sync(){
+        State& s = state();
+        hal::UartRegs& u = s.uart;
+        while (uart_active() && s.uart_next_byte <= s.now){
+            uint8_t b = *(const uint8_t*)u.UART_TPR.value;
+            if (s.capture_enabled) s.capture.push_back(b);
+            s.uart_bytes++;
+            u.UART_TPR.value++;
+            u.UART_TCR.value--;
+            if (u.UART_TCR.value == 0) s.uart_endtx = true;
+            if (u.UART_TCR.value == 0 && u.UART_TNCR.value > 0){
+                u.UART_TPR.value = u.UART_TNPR.value;
+                u.UART_TCR.value = u.UART_TNCR.value;
+                u.UART_TNCR.value = 0;
+            }
+            s.uart_next_byte += uart_byte_ns();
+        }
+        uintptr_t sr = UART_SR_TXRDY;
+        if (u.UART_TCR.value == 0 || s.uart_endtx) sr |= UART_SR_ENDTX;
+        if (u.UART_TCR.value == 0 && u.UART_TNCR.value == 0) sr |= UART_SR_TXBUFE;
+        if (!uart_active()) sr |= UART_SR_TXEMPTY;
+        u.UART_SR.value = sr;
+    }
+
+    /*
+     * Runs interrupt handlers that are due, unless interrupts are masked or we are already inside one.
+     */
+    void dispatch(){
+        State& s = state();
+        if (s.tick_enabled){
+            while (s.tick_next <= s.now){
+                s.tick_pending = true;
+                s.tick_next += s.tick_period;
+            }
+        }
+        if (s.masked || s.in_isr) return;
+        s.in_isr = true;
+        while (s.tick_pending){
+            TC0_Handler();
+        }
+        if (s.any_pin_pending){
+            s.any_pin_pending = false;
+            for (int pin = 0; pin < NUM_PINS; pin++){
+                if (s.pin_pending[pin]){
+                    s.pin_pending[pin] = false;
+                    s.pin_handlers[pin]();
+                }
+            }
+        }
+        uart_sync();
+        if (s.uart_irq && (s.uart.UART_IMR.value & s.uart.UART_SR.value)){
+            if (s.uart_handler) s.uart_handler();
+            else hal::uart_irq_disable();
+        }
+        while (s.dma_irq && s.dma_busy_until <= s.now){
+            DMAC_Handler();
+        }
+        s.in_isr = false;
+    }
+
+    void charge(uint64_t ns){
+        hal::sim::advance_ns(ns);
+    }
+
+    uint64_t dac_sweep_ticks_to_ns(uint64_t ticks){
+        return (ticks * 1000ULL + DAC_SWEEP_TICKS_PER_US - 1) / DAC_SWEEP_TICKS_PER_US;
+    }
+
+    /*
+     * Converts every half-word of a running DAC sweep whose trigger has come by now. Called before anyone looks at
+     * the DAC outputs, so conversions need no events of their own.
+     */
+    void dacc_sync(){
+        State& s = state();
+        while (s.dacc_running && s.dacc_next < 2 * s.dacc_count){
+            // Half-word j is converted on the rising edge of TIOA1, at (j + 1/2) trigger periods
+            uint64_t at = s.dacc_start + dac_sweep_ticks_to_ns((2 * s.dacc_next + 1) * (uint64_t)s.dacc_trigger_ticks / 2);
+            if (at > s.now) break;
+            uint32_t word = s.dacc_words[s.dacc_next / 2];
+            uint16_t half = (s.dacc_next & 1) ? (uint16_t)(word >> 16) : (uint16_t)word;
+            s.dac[(half >> 12) & 1] = half & 0x0FFF;
+            s.dacc_next++;
+        }
+    }
+
+    void spi_select(uint32_t pin){
+        State& s = state();
+        hal::sim::SpiDevice* dev = s.spi_devices[pin];
+        if (!dev) return;
+        s.selected = dev;
+        s.selected_pin = pin;
+        s.frame_start = true;
+        dev->select();
+    }
+
+    void spi_deselect(uint32_t pin){
+        State& s = state();
+        hal::sim::SpiDevice* dev = s.spi_devices[pin];
+        if (!dev) return;
+        dev->deselect();
+        if (s.selected == dev) s.selected = nullptr;
+    }
+
+    /*
+     * One byte with whatever device is selected. Does not charge time.
+     */
+    uint8_t spi_exchange(uint8_t mosi){
+        State& s = state();
+        uint8_t miso = s.selected ? s.selected->exchange(mosi) : 0xFF;
+        if (s.trace_enabled){
+            hal::sim::SpiTraceEntry e = { s.selected ? s.selected_pin : 0, mosi, miso, s.selected && s.frame_start };
+            s.trace.push_back(e);
+        }
+        s.frame_start = false;
+        return miso;
+    }
+
+    uint64_t spi_byte_ns(const hal::SpiSettings& settings){
+        return 8ULL * 1000000000ULL / settings.clock;
+    }
+
+    /*
+     * Pin driven by a chip select number in the PCS field of a TDR word (variable peripheral select, no decoder).
+     */
+    uint32_t pcs_pin(uint32_t word){
+        uint32_t pcs = (word >> 16) & 0xF;
+        if (!(pcs & 0x1)) return 10;
+        if (!(pcs & 0x2)) return 4;
+        if (!(pcs & 0x4)) return 52;
+        return 78;
+    }
+
+    /*
+     * One frame of a hardware chip select transfer: selects the device behind the word's PCS if needed, exchanges
+     * the frame MSB first and deselects on LASTXFER. Returns the received frame and adds its bus time to duration.
+     */
+    uint16_t hw_frame(uint32_t word, uint64_t& duration){
+        State& s = state();
+        uint32_t pin = pcs_pin(word);
+        if (!s.selected || s.selected_pin != pin){
+            if (s.selected) spi_deselect(s.selected_pin);
+            spi_select(pin);
+        }
+        uint16_t rx;
+        if (s.hw_cs_bits[pin] > 8){
+            // The Max1148 and AT25M02 models work in bytes, so a 16-bit frame is two of them back to back
+            rx = spi_exchange((uint8_t)(word >> 8)) << 8;
+            rx |= spi_exchange((uint8_t)word);
+        } else {
+            rx = spi_exchange((uint8_t)word);
+        }
+        if (word & (1u << 24)) spi_deselect(pin);
+        const hal::SpiSettings& settings = s.hw_cs[pin] ? s.hw_cs_settings[pin] : s.spi_settings;
+        duration += 1000000000ULL * s.hw_cs_bits[pin] / settings.clock + SIM_SPI_DLYBCT_NS;
+        return rx;
+    }
+}
+
+//========== Default interrupt vectors ==========//
+extern "C" {
+    __attribute__((weak)) void TC0_Handler(void){ hal::tick_timer_ack(); }
+    __attribute__((weak)) void DMAC_Handler(void){ hal::spi_dma_ack(); }
+}
+
+namespace hal {
+namespace sim {
+    uint64_t now_ns(){
+        return state().now;
+    }
+
+    void advance_ns(uint64_t ns){
+        State& s = state();
+        uint64_t target = s.now + ns;
+        // Nothing comes due before target, so nothing but the clock changes
+        if (target < next_event_ns()){
+            s.now = target;
+            return;
+        }
+        for (;;){
+            uint64_t next = next_event_ns();
+            if (next > target) next = target;
+            if (next > s.now) s.now = next;
+            while (!s.events.empty() && s.events.top().at <= s.now){
+                Event e = s.events.top();
+                s.events.pop();
+                e.fn(e.context);
+            }
+            uart_sync();
+            dispatch();
+            if (s.now >= target) break;
+        }
+    }
+
+    void schedule(uint64_t at_ns, EventFn fn, void* context){
+        State& s = state();
+        Event e = { at_ns, s.event_seq++, fn, context };
+        s.events.push(e);
+    }
+
+    uint64_t next_event_ns(){
+        State& s = state();
+        uint64_t next = UINT64_MAX;
+        if (s.tick_enabled && s.tick_next < next) next = s.tick_next;
+        if (uart_active() && s.uart_next_byte < next) next = s.uart_next_byte;
+        // Once due it is only pending, like a tick inside an interrupt handler, and dispatch() takes it when it can
+        if (s.dma_irq && s.dma_busy_until > s.now && s.dma_busy_until < next) next = s.dma_busy_until;
+        if (!s.events.empty() && s.events.top().at < next) next = s.events.top().at;
+        return next;
+    }
+
+    void skip_to_next_event(){
+        uint64_t next = next_event_ns();
+        uint64_t now = state().now;
+        if (next != UINT64_MAX) advance_ns(next > now ? next - now : 0);
+    }
+
+    void pin_falling_edge(uint32_t pin){
+        State& s = state();
+        bool was_high = s.pins[pin] != LOW;
+        s.pins[pin] = LOW;
+        if (was_high && s.pin_handlers[pin] && (s.pin_modes[pin] == FALLING || s.pin_modes[pin] == CHANGE)){
+            s.pin_pending[pin] = true;
+            s.any_pin_pending = true;
+            dispatch();
+        }
+        // Pulses are short, the line is back up by the time anything polls it
+        s.pins[pin] = HIGH;
+    }
+
+    void attach_spi_device(uint32_t cs_pin, SpiDevice* device){
+        state().spi_devices[cs_pin] = device;
+    }
+
+    void spi_trace_enable(bool enable){
+        State& s = state();
+        s.trace_enabled = enable;
+        if (enable) s.trace.clear();
+    }
+
+    std::vector<SpiTraceEntry>& spi_trace(){
+        return state().trace;
+    }
+
+    Max1148Model& adc(){ return state().adc; }
+    AT25M02Model& eeprom(){ return state().eeprom; }
+
+    uint32_t dac_value(uint32_t pin){
+        dacc_sync();
+        return state().dac[pin == DAC1 ? 1 : 0];
+    }
+
+    int pin_state(uint32_t pin){
+        return state().pins[pin];
+    }
+
+    uint64_t uart_bytes_sent(){
+        uart_sync();
+        return state().uart_bytes;
+    }
+
+    std::vector<uint8_t>& uart_capture(){
+        uart_sync();
+        return state().capture;
+    }
+
+    void uart_capture_enable(bool enable){
+        state().capture_enabled = enable;
+    }
+
+    //========== Max1148 model ==========//
+    Max1148Model::Max1148Model() : conversions(0), out_len(0), noise(2463534242u) {
+        for (int i = 0; i < 8; i++) dac_of_channel[i] = -1;
+    }
+
+    void Max1148Model::seed(uint32_t seed){
+        noise = seed ? seed : 2463534242u;
+    }
+
+    void Max1148Model::wire(int channel, uint32_t dac_pin){
+        dac_of_channel[channel] = dac_pin;
+    }
+
+    int Max1148Model::channel_of(uint8_t control){
+        uint8_t sel = (control >> 4) & 0x07;
+        // SEL2 picks bit 0, SEL0 picks bit 1, SEL1 picks bit 2 of the channel number
+        return ((sel >> 2) & 1) | ((sel & 1) << 1) | (((sel >> 1) & 1) << 2);
+    }
+
+    uint16_t Max1148Model::sample(int channel){
+        if (dac_of_channel[channel] < 0) return 0;
+        double v = (double)dac_value(dac_of_channel[channel]);
+        // Ion saturation plus a saturating electron branch, centered in the shields' sweep range.
+        double i = 1500.0 + 9000.0 / (1.0 + exp(-(v - 2250.0) / 120.0));
+        noise ^= noise << 13;
+        noise ^= noise >> 17;
+        noise ^= noise << 5;
+        int code = (int)i + (int)(noise % 17) - 8;
+        if (code < 0) code = 0;
+        if (code > 0x3FFF) code = 0x3FFF;
+        return (uint16_t)code;
+    }
+
+    void Max1148Model::deselect(){
+        out_len = 0;
+    }
+
+    uint8_t Max1148Model::exchange(uint8_t mosi){
+        uint8_t miso = 0;
+        if (out_len){
+            miso = out[0];
+            out[0] = out[1];
+            out_len--;
+        }
+        if (mosi & 0x80){
+            uint16_t result = sample(channel_of(mosi)) << 2;
+            out[out_len++] = (uint8_t)(result >> 8);
+            out[out_len++] = (uint8_t)(result & 0xFF);
+            conversions++;
+        }
+        return miso;
+    }
+
+    //========== AT25M02 model ==========//
+    AT25M02Model::AT25M02Model() : memory(SIM_EEPROM_SIZE, 0xFF), status(0), busy_until_ns(0), page_writes(0),
+        status_polls(0), bytes_read(0), rejected_while_busy(0), writes_without_wel(0), reads_wrapped(0),
+        page_rollovers(0), opcode(0), byte_index(0),
+        address(0), data_bytes(0), new_status(0) {}
+
+    bool AT25M02Model::busy() const {
+        return now_ns() < busy_until_ns;
+    }
+
+    void AT25M02Model::select(){
+        byte_index = 0;
+        opcode = 0;
+        address = 0;
+        data_bytes = 0;
+    }
+
+    uint8_t AT25M02Model::exchange(uint8_t mosi){
+        int i = byte_index++;
+        if (i == 0){
+            opcode = mosi;
+            if (busy() && opcode != 0x05){
+                rejected_while_busy++;
+                opcode = 0;
+            }
+            if (opcode == 0x05) status_polls++;
+            return 0xFF;
+        }
+        switch (opcode){
+            case 0x05:
+                // Status keeps coming out for as long as chip select is held
+                return (status & ~0x01) | (busy() ? 0x01 : 0x00);
+            case 0x01:
+                if (i == 1) new_status = mosi;
+                return 0xFF;
+            case 0x03:
+                if (i <= 3){
+                    address = ((address << 8) | mosi) & (SIM_EEPROM_SIZE - 1);
+                    return 0xFF;
+                } else {
+                    if (address == 0 && i > 4) reads_wrapped++;
+                    uint8_t b = memory[address];
+                    address = (address + 1) & (SIM_EEPROM_SIZE - 1);
+                    bytes_read++;
+                    return b;
+                }
+            case 0x02:
+                if (i <= 3){
+                    address = ((address << 8) | mosi) & (SIM_EEPROM_SIZE - 1);
+                    if (i == 3) memcpy(page, &memory[address & ~(SIM_EEPROM_PAGE_LEN - 1)], SIM_EEPROM_PAGE_LEN);
+                } else {
+                    // Page buffer rolls over inside the page
+                    page[(address + data_bytes) & (SIM_EEPROM_PAGE_LEN - 1)] = mosi;
+                    data_bytes++;
+                }
+                return 0xFF;
+            default:
+                return 0xFF;
+        }
+    }
+
+    void AT25M02Model::deselect(){
+        switch (opcode){
+            case 0x06:
+                status |= 0x02;
+                break;
+            case 0x04:
+                status &= ~0x02;
+                break;
+            case 0x01:
+                if (byte_index < 2) break;
+                if (!(status & 0x02)){
+                    writes_without_wel++;
+                    break;
+                }
+                status = (status & 0x03) | (new_status & 0x8C);
+                status &= ~0x02;
+                busy_until_ns = now_ns() + SIM_EEPROM_WRITE_CYCLE_NS;
+                break;
+            case 0x02:
+                if (data_bytes == 0) break;
+                if (!(status & 0x02)){
+                    writes_without_wel++;
+                    break;
+                }
+                memcpy(&memory[address & ~(SIM_EEPROM_PAGE_LEN - 1)], page, SIM_EEPROM_PAGE_LEN);
+                page_writes++;
+                if ((address & (SIM_EEPROM_PAGE_LEN - 1)) + data_bytes > SIM_EEPROM_PAGE_LEN) page_rollovers++;
+                status &= ~0x02;
+                busy_until_ns = now_ns() + SIM_EEPROM_WRITE_CYCLE_NS;
+                break;
+            default:
+                break;
+        }
+        opcode = 0;
+    }
+}
+
+//========== SPI bus ==========//
+void spi_begin(){}
+
+void spi_begin_transaction(const SpiSettings& settings){
+    state().spi_settings = settings;
+}
+
+uint8_t spi_transfer(uint8_t data){
+    uint8_t miso = spi_exchange(data);
+    charge(spi_byte_ns(state().spi_settings) + SIM_SPI_BYTE_OVERHEAD_NS);
+    return miso;
+}
+
+void spi_transfer(void* buffer, size_t length){
+    uint8_t* p = (uint8_t*)buffer;
+    for (size_t i = 0; i < length; i++){
+        p[i] = spi_transfer(p[i]);
+    }
+}
+
+void spi_end_transaction(){}
+
+void spi_hw_cs_begin(uint32_t pin, const SpiSettings& settings, uint8_t bits){
+    State& s = state();
+    s.hw_cs[pin] = true;
+    s.hw_cs_settings[pin] = settings;
+    s.hw_cs_bits[pin] = bits;
+}
+
+uint32_t spi_tdr(uint32_t pin, uint16_t data, bool last){
+    uint32_t channel = pin == 10 ? 0 : (pin == 4 ? 1 : (pin == 52 ? 2 : 3));
+    uint32_t word = data | ((~(1u << channel) & 0xF) << 16);
+    return last ? (word | (1u << 24)) : word;
+}
+
+void spi_dma_start(const uint32_t* tx, uint16_t* rx, size_t count){
+    State& s = state();
+    // The bytes are exchanged up front and the transfer time is charged by spi_dma_busy(). The devices only see
+    // the bytes, so nothing can tell the difference, except that a device's own timers start at the beginning of the
+    // transfer rather than the end: the EEPROM's write cycle for a DMA page program, about 0.5 ms early.
+    s.dma_irq = false;
+    uint64_t duration = 0;
+    for (size_t i = 0; i < count; i++){
+        rx[i] = hw_frame(tx[i], duration);
+    }
+    s.dma_busy_until = s.now + duration;
+}
+
+uint16_t spi_frame(uint32_t word){
+    uint64_t duration = SIM_SPI_FRAME_OVERHEAD_NS;
+    uint16_t rx = hw_frame(word, duration);
+    charge(duration);
+    return rx;
+}
+
+bool spi_dma_busy(){
+    State& s = state();
+    // The CPU can only spin here, so jump to the end of the transfer. Interrupts still run on the way.
+    if (s.now < s.dma_busy_until){
+        charge(s.dma_busy_until - s.now);
+        return true;
+    }
+    return false;
+}
+
+void spi_dma_notify(){
+    state().dma_irq = true;
+    dispatch();
+}
+
+void spi_dma_ack(){
+    state().dma_irq = false;
+}
+
+//========== GPIO ==========//
+void pin_mode(uint32_t pin, uint32_t mode){
+    (void)mode;
+    // Back to GPIO if it was a hardware chip select
+    state().hw_cs[pin] = false;
+}
+
+void digital_write(uint32_t pin, uint32_t value){
+    State& s = state();
+    int old = s.pins[pin];
+    s.pins[pin] = value ? HIGH : LOW;
+    if (old != s.pins[pin] && !s.hw_cs[pin]){
+        if (s.pins[pin] == LOW) spi_select(pin);
+        else spi_deselect(pin);
+    }
+    charge(SIM_DIGITAL_WRITE_NS);
+}
+
+int digital_read(uint32_t pin){
+    return state().pins[pin];
+}
+
+//========== DAC ==========//
+void dac_resolution(int bits){
+    (void)bits;
+}
+
+void dac_write(uint32_t pin, uint32_t value){
+    state().dac[pin == DAC1 ? 1 : 0] = value;
+    charge(SIM_DAC_WRITE_NS);
+}
+
+//========== Clock ==========//
+uint32_t micros(){
+    charge(SIM_MICROS_NS);
+    return (uint32_t)(state().now / 1000ULL);
+}
+
+void delay_us(uint32_t us){
+    charge((uint64_t)us * 1000ULL);
+}
+
+void delay_ms(uint32_t ms){
+    charge((uint64_t)ms * 1000000ULL);
+}
+
+void cycle_counter_begin(){}
+
+uint32_t cycle_count(){
+    return (uint32_t)(state().now * SIM_MCK_HZ / 1000000000ULL);
+}
+
+//========== UART ==========//
+void uart_begin(uint32_t baud){
+    state().baud = baud;
+}
+
+UartRegs* uart_regs(){
+    return &state().uart;
+}
+
+void uart_irq_enable(){
+    state().uart_irq = true;
+    dispatch();
+}
+
+void uart_irq_disable(){
+    state().uart_irq = false;
+}
+
+void uart_attach_interrupt(void (*handler)()){
+    state().uart_handler = handler;
+}
+
+UartReg::operator uintptr_t() const {
+    uart_sync();
+    return value;
+}
+
+UartReg& UartReg::operator=(uintptr_t v){
+    State& s = state();
+    UartRegs& u = s.uart;
+    uart_sync();
+    switch (index){
+        case UartRegs::IER:
+            u.UART_IMR.value |= v;
+            break;
+        case UartRegs::IDR:
+            u.UART_IMR.value &= ~v;
+            break;
+        case UartRegs::PTCR:
+            if (v & TXTEN) u.UART_PTSR.value |= TXTEN;
+            if (v & TXTDIS) u.UART_PTSR.value &= ~TXTEN;
+            break;
+        case UartRegs::TCR:
+            if (value == 0 && v > 0) s.uart_next_byte = s.now + uart_byte_ns();
+            value = v;
+            s.uart_endtx = false;
+            break;
+        case UartRegs::TNCR:
+            value = v;
+            s.uart_endtx = false;
+            break;
+        case UartRegs::IMR:
+        case UartRegs::SR:
+        case UartRegs::PTSR:
+            // read only
+            break;
+        default:
+            value = v;
+            break;
+    }
+    uart_sync();
+    dispatch();
+    return *this;
+}
+
+//========== I2C ==========//
+void i2c_begin(){}
+
+//========== Interrupts ==========//
+IrqState irq_save(){
+    State& s = state();
+    IrqState old = s.masked;
+    s.masked = true;
+    return old;
+}
+
+void irq_restore(IrqState masked){
+    state().masked = masked;
+    dispatch();
+}
+
+void attach_interrupt(uint32_t pin, void (*handler)(), uint32_t mode){
+    state().pin_handlers[pin] = handler;
+    state().pin_modes[pin] = mode;
+}
+
+void tick_timer_begin(uint32_t rc){
+    State& s = state();
+    s.tick_period = (1000000000ULL * (rc + 1)) / TC0_CLOCK_HZ;
+    s.tick_next = s.now + s.tick_period;
+    s.tick_pending = false;
+    s.tick_enabled = true;
+}
+
+void tick_timer_ack(){
+    state().tick_pending = false;
+}
+
+//========== Timer triggered DAC sweep ==========//
+void dac_sweep_start(const uint32_t* words, size_t count, uint32_t trigger_ticks){
+    State& s = state();
+    s.dacc_running = true;
+    s.dacc_words = words;
+    s.dacc_count = count;
+    s.dacc_trigger_ticks = trigger_ticks;
+    s.dacc_start = s.now;
+    s.dacc_next = 0;
+}
+
+uint32_t dac_sweep_ticks(){
+    State& s = state();
+    return (uint32_t)((s.now - s.dacc_start) * DAC_SWEEP_TICKS_PER_US / 1000ULL);
+}
+
+void dac_sweep_wait(uint32_t ticks){
+    State& s = state();
+    uint64_t at = s.dacc_start + dac_sweep_ticks_to_ns(ticks);
+    if (at > s.now) charge(at - s.now);
+}
+
+void dac_sweep_stop(){
+    dacc_sync();
+    state().dacc_running = false;
+}
+}
+
+//========== IMU stand-ins ==========//
+namespace {
+    // Payload spin rate in Hz
+    const double SPIN_HZ = 2.3;
+    double flight_seconds(){
+        return (double)hal::sim::now_ns() * 1e-9;
+    }
+}
+
+void LIS3MDL::writeReg(uint8_t reg, uint8_t value){
+    (void)reg;
+    (void)value;
+    hal::sim::advance_ns(3 * SIM_I2C_BYTE_NS);
+}
+
+void LIS3MDL::read(){
+    double phase = 2.0 * M_PI * SPIN_HZ * flight_seconds();
+    m.x = (int16_t)(3000.0 * cos(phase));
+    m.y = (int16_t)(3000.0 * sin(phase));
+    m.z = 1200;
+    hal::sim::advance_ns(9 * SIM_I2C_BYTE_NS);
+}
+
+void LSM6::writeReg(uint8_t reg, uint8_t value){
+    (void)reg;
+    (void)value;
+    hal::sim::advance_ns(3 * SIM_I2C_BYTE_NS);
+}
+
+void LSM6::read(){
+    double phase = 2.0 * M_PI * SPIN_HZ * flight_seconds();
+    a.x = (int16_t)(200.0 * cos(phase));
+    a.y = (int16_t)(200.0 * sin(phase));
+    a.z = -8192;
+    g.x = 15;
+    g.y = -22;
+    g.z = (int16_t)(SPIN_HZ * 360.0 / 0.035);
+    hal::sim::advance_ns(15 * SIM_I2C_BYTE_NS);
+}
+#endif
@@ -4,16 +4,12 @@
  * 
  * There is extensive sensor and register information commented in this file.
  */
-#include <Arduino.h>
-#include <Wire.h>
-#include <LIS3MDL.h>
-#include <LSM6.h>
 #include<IMU.hpp>
 
 //note - it's two byte data.
 /** @copydoc initIMU() */
 void initIMU(LIS3MDL* mag, LSM6* gyro_acc){
-  Wire.begin();
+  hal::i2c_begin();
   mag->init();
   gyro_acc->init();
 
@@ -18,28 +18,104 @@ uint16_t Max1148::adc_read(){
     //SPI.beginTransaction(SPISettings(SPI_SPEED, MSBFIRST, SPI_MODE));
     //data from each sample
     uint16_t data = 0;
+    if (transport == AdcTransport::HW_CS16){
+        //control byte, then a frame of zeros clocks the whole result out
+        hal::spi_frame(hal::spi_tdr(cs_pin, channel, false));
+        return hal::spi_frame(hal::spi_tdr(cs_pin, ADC_READ, true));
+    }
     //total data from all samples
     //send command to congfigure ADC channel
     csl();
     //note - manual delay removed because we are on external clock now.
-    SPI.transfer(channel);
+    hal::spi_transfer(channel);
     //delayMicroseconds(50);
     //send dummy byte to get first byte of data
-    data = SPI.transfer(ADC_READ) << 8;
+    data = hal::spi_transfer(ADC_READ) << 8;
     //Max1148 is a 14 bit ADC - so we have to do two SPI transfers to get all the data.
-    data |= SPI.transfer(ADC_READ);
+    data |= hal::spi_transfer(ADC_READ);
     //add data to total. Shifted right because result is left justified - Jacob
     csh();
     //SPI.endTransaction();
     return data;
 }
 
+/** @copydoc Max1148::pipeline_start() */
+void Max1148::pipeline_start(){
+    if (transport == AdcTransport::HW_CS16){
+        hal::spi_frame(hal::spi_tdr(cs_pin, channel, false));
+        return;
+    }
+    csl();
+    hal::spi_transfer(channel);
+}
+
+/** @copydoc Max1148::pipeline_read(const Max1148* next) */
+uint16_t Max1148::pipeline_read(const Max1148* next){
+    if (transport == AdcTransport::HW_CS16){
+        return hal::spi_frame(next ? hal::spi_tdr(cs_pin, next->channel, false) : hal::spi_tdr(cs_pin, ADC_READ, true));
+    }
+    uint16_t data = hal::spi_transfer(ADC_READ) << 8;
+    data |= hal::spi_transfer(next ? next->channel : ADC_READ);
+    if (!next) csh();
+    return data;
+}
+
+/** @copydoc Max1148::set_transport(AdcTransport t) */
+void Max1148::set_transport(AdcTransport t){
+    transport = t;
+    if (t == AdcTransport::HW_CS16){
+        hal::spi_hw_cs_begin(cs_pin, hal::SpiSettings(SPI_SPEED, MSBFIRST, SPI_MODE), 16);
+    } else {
+        claim_cs(false);
+    }
+}
+
+/** @copydoc Max1148::claim_cs(bool hardware) */
+void Max1148::claim_cs(bool hardware){
+    if (transport == AdcTransport::HW_CS16) return;
+    if (hardware){
+        hal::spi_hw_cs_begin(cs_pin, hal::SpiSettings(SPI_SPEED, MSBFIRST, SPI_MODE), 8);
+    } else {
+        hal::pin_mode(cs_pin, OUTPUT);
+        hal::digital_write(cs_pin, HIGH);
+    }
+}
+
+/** @copydoc Max1148::dma_words(uint32_t* words) */
+int Max1148::dma_words(uint32_t* words) const {
+    if (transport == AdcTransport::HW_CS16){
+        words[0] = hal::spi_tdr(cs_pin, channel, false);
+        words[1] = hal::spi_tdr(cs_pin, ADC_READ, true);
+        return 2;
+    }
+    words[0] = hal::spi_tdr(cs_pin, channel, false);
+    words[1] = hal::spi_tdr(cs_pin, ADC_READ, false);
+    words[2] = hal::spi_tdr(cs_pin, ADC_READ, true);
+    return 3;
+}
+
+/** @copydoc Max1148::dma_start_word() */
+uint32_t Max1148::dma_start_word() const {
+    return hal::spi_tdr(cs_pin, channel, false);
+}
+
+/** @copydoc Max1148::dma_words_next(uint32_t* words, const Max1148* next) */
+int Max1148::dma_words_next(uint32_t* words, const Max1148* next) const {
+    if (transport == AdcTransport::HW_CS16){
+        words[0] = next ? hal::spi_tdr(cs_pin, next->channel, false) : hal::spi_tdr(cs_pin, ADC_READ, true);
+        return 1;
+    }
+    words[0] = hal::spi_tdr(cs_pin, ADC_READ, false);
+    words[1] = next ? hal::spi_tdr(cs_pin, next->channel, false) : hal::spi_tdr(cs_pin, ADC_READ, true);
+    return 2;
+}
+
 /** @copydoc Max1148::csl() */
 void Max1148::csl(){
-    digitalWrite(cs_pin, LOW);
+    hal::digital_write(cs_pin, LOW);
 }
 
 /** @copydoc Max1148::csh() */
 void Max1148::csh(){
-    digitalWrite(cs_pin, HIGH);
+    hal::digital_write(cs_pin, HIGH);
 }
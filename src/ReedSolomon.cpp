@@ -0,0 +1,109 @@
+/**
+ * @file ReedSolomon.cpp
+ * @brief Reed-Solomon decoder for the ground. See ReedSolomon.hpp.
+ */
+#ifndef ARDUINO
+#include <ReedSolomon.hpp>
+#include <string.h>
+
+namespace {
+    typedef gf256::Tables<> T;
+
+    inline uint8_t mul(uint8_t a, uint8_t b){
+        return a == 0 || b == 0 ? 0 : T::exp[T::log[a] + T::log[b]];
+    }
+
+    inline uint8_t div(uint8_t a, uint8_t b){
+        return a == 0 ? 0 : T::exp[T::log[a] + 255 - T::log[b]];
+    }
+
+    /*
+     * alpha^power for any power, negative included.
+     */
+    inline uint8_t alphaTo(int power){
+        power %= 255;
+        return T::exp[power < 0 ? power + 255 : power];
+    }
+
+    /*
+     * p(x) for p of the given degree, coefficients lowest degree first.
+     */
+    uint8_t evaluate(const uint8_t* p, int degree, uint8_t x){
+        uint8_t y = 0;
+        for (int i = degree; i >= 0; i--) y = mul(y, x) ^ p[i];
+        return y;
+    }
+}
+
+int rsDecode(uint8_t* block, size_t length){
+    if (length <= RS_PARITY || length > RS_BLOCK_MAX) return -1;
+    // Syndromes: the block, first byte highest degree, at each generator root
+    uint8_t syndromes[RS_PARITY];
+    bool clean = true;
+    for (int j = 0; j < RS_PARITY; j++){
+        uint8_t root = T::exp[j];
+        uint8_t s = 0;
+        for (size_t i = 0; i < length; i++) s = mul(s, root) ^ block[i];
+        syndromes[j] = s;
+        clean = clean && s == 0;
+    }
+    if (clean) return 0;
+
+    // Berlekamp-Massey: error locator lambda, lowest degree first
+    uint8_t lambda[RS_PARITY + 1] = {1};
+    uint8_t previous[RS_PARITY + 1] = {1};
+    int errors = 0;
+    int shift = 1;
+    uint8_t last_discrepancy = 1;
+    for (int n = 0; n < RS_PARITY; n++){
+        uint8_t discrepancy = syndromes[n];
+        for (int i = 1; i <= errors; i++) discrepancy ^= mul(lambda[i], syndromes[n - i]);
+        if (discrepancy == 0){
+            shift++;
+            continue;
+        }
+        uint8_t scale = div(discrepancy, last_discrepancy);
+        uint8_t before[RS_PARITY + 1];
+        memcpy(before, lambda, sizeof(lambda));
+        for (int i = 0; i + shift <= RS_PARITY; i++) lambda[i + shift] ^= mul(scale, previous[i]);
+        if (2 * errors <= n){
+            errors = n + 1 - errors;
+            memcpy(previous, before, sizeof(previous));
+            last_discrepancy = discrepancy;
+            shift = 1;
+        } else {
+            shift++;
+        }
+    }
+    if (2 * errors > RS_PARITY) return -1;
+
+    // Error evaluator omega = syndromes * lambda mod x^RS_PARITY
+    uint8_t omega[RS_PARITY] = {0};
+    for (int i = 0; i < RS_PARITY; i++){
+        for (int j = 0; j <= errors && j <= i; j++) omega[i] ^= mul(syndromes[i - j], lambda[j]);
+    }
+    // Formal derivative of lambda: odd powers only in GF(2^m)
+    uint8_t derivative[RS_PARITY] = {0};
+    for (int i = 1; i <= errors; i += 2) derivative[i - 1] = lambda[i];
+
+    // Chien search over the positions actually in the (shortened) block, Forney for each error found
+    int positions[RS_PARITY / 2];
+    uint8_t values[RS_PARITY / 2];
+    int found = 0;
+    for (size_t i = 0; i < length; i++){
+        int degree = (int)(length - 1 - i);
+        uint8_t inverse = alphaTo(-degree);  // X^-1, X = alpha^degree
+        if (evaluate(lambda, errors, inverse) != 0) continue;
+        if (found == errors) return -1;
+        uint8_t denominator = evaluate(derivative, errors - 1, inverse);
+        if (denominator == 0) return -1;
+        // Roots start at alpha^0, so the magnitude is X * omega(X^-1) / lambda'(X^-1)
+        positions[found] = (int)i;
+        values[found] = mul(alphaTo(degree), div(evaluate(omega, RS_PARITY - 1, inverse), denominator));
+        found++;
+    }
+    if (found != errors) return -1;
+    for (int e = 0; e < found; e++) block[positions[e]] ^= values[e];
+    return found;
+}
+#endif
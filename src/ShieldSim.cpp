@@ -0,0 +1,218 @@
+/**
+ * @file ShieldSim.cpp
+ * @brief Discrete-event flight simulation. See ShieldSim.hpp.
+ */
+#ifndef ARDUINO
+#include <ShieldSim.hpp>
+#include <HALSim.hpp>
+#include <FSM.hpp>
+#include <AT25M02.hpp>
+#include <TelemetryScheduler.hpp>
+#include <Counters.hpp>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FLIGHT_DEFAULT_SECONDS 900
+#define FLIGHT_DEFAULT_PERIOD_US 22222 // SAMPLE_PERIOD in sweep_values_v5_1.h
+#define FLIGHT_REPORT_INTERVAL_S 60
+#define FLIGHT_SYNC_PIN 53 // SYNC_PIN in main.cpp
+#define FLIGHT_BAUD 230400 // hal::uart_begin() in main.cpp
+#define NS_PER_US 1000ULL
+#define NS_PER_S 1000000000ULL
+
+//========== From main.cpp ==========//
+void setup();
+void loop();
+extern AT25M02 ram;
+extern TelemetryScheduler scheduler;
+
+namespace {
+    const char* const STATE_NAMES[NUM_BOB_STATES] = {
+        "idle", "startSweep", "sendSweep", "takeIMU", "sendIMU", "sendStored",
+        "sendTimeStamps", "waitForNewCycle", "interrupted", "store", "read"
+    };
+
+    struct Flight {
+        // Profile
+        uint64_t period_ns;
+        uint64_t end_ns;
+        uint64_t sync_off_from_ns;
+        uint64_t sync_off_to_ns;
+        // Per cycle
+        uint64_t sweeps_this_cycle;
+        uint64_t uart_at_cycle_start;
+        // Totals
+        uint64_t state_ns[NUM_BOB_STATES];
+        uint64_t cycles;
+        uint64_t missed_cycles;
+        uint64_t sweeps;
+        uint64_t interrupted;
+        uint64_t uart_bytes;
+        uint64_t uart_max_cycle;
+        uint32_t backlog_max;
+        // Report interval
+        uint64_t next_report_ns;
+        uint64_t interval_cycles;
+        uint64_t interval_missed;
+        uint64_t interval_uart;
+        uint64_t start_ns;
+    };
+
+    double link_load(const Flight& f, double bytes_per_cycle){
+        double cycle_s = (double)f.period_ns / NS_PER_S;
+        return 100.0 * bytes_per_cycle * 10.0 / (FLIGHT_BAUD * cycle_s);
+    }
+
+    void report(Flight& f){
+        double t = (double)(hal::sim::now_ns() - f.start_ns) / NS_PER_S;
+        double per_cycle = f.interval_cycles ? (double)f.interval_uart / f.interval_cycles : 0;
+        printf("t=%6.0fs  cycles=%6llu  missed=%4llu  uart=%6.1f B/cycle (%5.1f%% link)  eeprom backlog=%6lu B"
+               "  draining %6ld B/s\n",
+               t, (unsigned long long)f.interval_cycles, (unsigned long long)f.interval_missed,
+               per_cycle, link_load(f, per_cycle), (unsigned long)ram.usedBytes(), (long)scheduler.get_drain_rate());
+        f.interval_cycles = 0;
+        f.interval_missed = 0;
+        f.interval_uart = 0;
+    }
+
+    /*
+     * Cycle boundary. Closes the books on the cycle that just ended and, unless the sync line is out, pulses SYNC_PIN.
+     */
+    void cycleEvent(void* context){
+        Flight& f = *(Flight*)context;
+        uint64_t now = hal::sim::now_ns();
+        if (f.cycles > 0){
+            uint64_t sent = hal::sim::uart_bytes_sent();
+            uint64_t bytes = sent - f.uart_at_cycle_start;
+            f.uart_at_cycle_start = sent;
+            f.uart_bytes += bytes;
+            f.interval_uart += bytes;
+            if (bytes > f.uart_max_cycle) f.uart_max_cycle = bytes;
+            if (f.sweeps_this_cycle == 0){
+                f.missed_cycles++;
+                f.interval_missed++;
+            }
+            f.interval_cycles++;
+        }
+        f.sweeps_this_cycle = 0;
+        f.cycles++;
+        uint32_t backlog = ram.usedBytes();
+        if (backlog > f.backlog_max) f.backlog_max = backlog;
+        if (now >= f.next_report_ns){
+            report(f);
+            f.next_report_ns += FLIGHT_REPORT_INTERVAL_S * NS_PER_S;
+        }
+        uint64_t t = now - f.start_ns;
+        if (t < f.sync_off_from_ns || t >= f.sync_off_to_ns){
+            hal::sim::pin_falling_edge(FLIGHT_SYNC_PIN);
+        }
+        if (now + f.period_ns < f.end_ns){
+            hal::sim::schedule(now + f.period_ns, cycleEvent, context);
+        }
+    }
+
+    void summary(const Flight& f){
+        uint64_t total = 0;
+        for (int i = 0; i < NUM_BOB_STATES; i++) total += f.state_ns[i];
+        printf("\nTime per state:\n");
+        for (int i = 0; i < NUM_BOB_STATES; i++){
+            if (f.state_ns[i] == 0) continue;
+            printf("  %-16s %10.3f s  %5.1f%%\n", STATE_NAMES[i], (double)f.state_ns[i] / NS_PER_S,
+                   100.0 * f.state_ns[i] / total);
+        }
+        uint64_t closed = f.cycles ? f.cycles - 1 : 0;
+        double per_cycle = closed ? (double)f.uart_bytes / closed : 0;
+        printf("\nCycles: %llu  sweeps: %llu  missed cycles: %llu  interrupted: %llu\n",
+               (unsigned long long)closed, (unsigned long long)f.sweeps,
+               (unsigned long long)f.missed_cycles, (unsigned long long)f.interrupted);
+        printf("UART: %.1f B/cycle mean (%.1f%% link), %llu B/cycle max (%.1f%% link)\n",
+               per_cycle, link_load(f, per_cycle), (unsigned long long)f.uart_max_cycle, link_load(f, f.uart_max_cycle));
+        printf("EEPROM backlog: %lu B at end, %lu B max, %llu pages written\n",
+               (unsigned long)ram.usedBytes(), (unsigned long)f.backlog_max,
+               (unsigned long long)hal::sim::eeprom().page_writes);
+        printf("Replay: %lu records, link budget %lu B/cycle\n", (unsigned long)scheduler.get_replayed(),
+               (unsigned long)scheduler.budget());
+        printf("Counters:");
+        for (int i = 0; i < NUM_COUNTERS; i++){
+            printf("%s %s %lu", i % 5 ? "," : "\n ", counters::name((Counter)i), (unsigned long)counters::get((Counter)i));
+        }
+        printf("\n");
+    }
+
+    bool parseRange(const char* arg, uint64_t& from, uint64_t& to){
+        double a, b;
+        if (sscanf(arg, "%lf:%lf", &a, &b) != 2) return false;
+        from = (uint64_t)(a * NS_PER_S);
+        to = (uint64_t)(b * NS_PER_S);
+        return true;
+    }
+}
+
+int runFlight(int argc, char** argv){
+    Flight f;
+    memset(&f, 0, sizeof(f));
+    double seconds = FLIGHT_DEFAULT_SECONDS;
+    f.period_ns = FLIGHT_DEFAULT_PERIOD_US * NS_PER_US;
+    const char* capture = nullptr;
+    for (int i = 0; i < argc; i++){
+        bool has_value = i + 1 < argc;
+        if (!strcmp(argv[i], "--seconds") && has_value){
+            seconds = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--period") && has_value){
+            f.period_ns = (uint64_t)atol(argv[++i]) * NS_PER_US;
+        } else if (!strcmp(argv[i], "--sync-off") && has_value){
+            if (!parseRange(argv[++i], f.sync_off_from_ns, f.sync_off_to_ns)) return 2;
+        } else if (!strcmp(argv[i], "--capture") && has_value){
+            capture = argv[++i];
+        } else {
+            fprintf(stderr, "unknown flight option %s\n", argv[i]);
+            return 2;
+        }
+    }
+    hal::sim::uart_capture_enable(capture != nullptr);
+
+    setup();
+    f.start_ns = hal::sim::now_ns();
+    f.end_ns = f.start_ns + (uint64_t)(seconds * NS_PER_S);
+    f.next_report_ns = f.start_ns + FLIGHT_REPORT_INTERVAL_S * NS_PER_S;
+    hal::sim::schedule(f.start_ns + f.period_ns, cycleEvent, &f);
+
+    BobState last = currentState;
+    while (hal::sim::now_ns() < f.end_ns){
+        uint64_t t0 = hal::sim::now_ns();
+        loop();
+        BobState state = currentState;
+        if (hal::sim::now_ns() == t0){
+            // Only an interrupt can move the state machine on from here
+            hal::sim::skip_to_next_event();
+        } else {
+            hal::sim::advance_ns(SIM_LOOP_NS);
+        }
+        f.state_ns[state] += hal::sim::now_ns() - t0;
+        if (state != last){
+            if (state == startSweep){
+                f.sweeps++;
+                f.sweeps_this_cycle++;
+            } else if (state == interrupted){
+                f.interrupted++;
+            }
+            last = state;
+        }
+    }
+    summary(f);
+
+    if (capture){
+        FILE* out = fopen(capture, "wb");
+        if (!out){
+            perror(capture);
+            return 1;
+        }
+        std::vector<uint8_t>& bytes = hal::sim::uart_capture();
+        fwrite(bytes.data(), 1, bytes.size(), out);
+        fclose(out);
+        printf("Wrote %lu UART bytes to %s\n", (unsigned long)bytes.size(), capture);
+    }
+    return 0;
+}
+#endif
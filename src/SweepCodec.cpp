@@ -0,0 +1,198 @@
+/**
+ * @file SweepCodec.cpp
+ * @brief Sweep encoder for the shield and decoder for the ground. See SweepCodec.hpp.
+ */
+#include <SweepCodec.hpp>
+
+namespace {
+    inline int32_t clamp(int32_t prediction){
+        return prediction < 0 ? 0 : prediction > 0xFFFF ? 0xFFFF : prediction;
+    }
+
+    /*
+     * Prediction for step i of probe, see SweepCodec.hpp. previous is the probe before it, for SWEEP_PREDICT_PROBE.
+     */
+    inline int32_t predict(const uint16_t* probe, const uint16_t* previous, size_t i, int predictor){
+        if (predictor == SWEEP_PREDICT_PROBE){
+            return i == 0 ? previous[0] : clamp((int32_t)previous[i] + probe[i - 1] - previous[i - 1]);
+        }
+        return i == 1 ? probe[0] : clamp(2 * (int32_t)probe[i - 1] - probe[i - 2]);
+    }
+
+    inline uint32_t fold(int32_t residual){
+        return residual >= 0 ? (uint32_t)residual << 1 : ((uint32_t)-residual << 1) - 1;
+    }
+
+    inline int32_t unfold(uint32_t folded){
+        return (folded & 1) ? -(int32_t)((folded + 1) >> 1) : (int32_t)(folded >> 1);
+    }
+
+    inline size_t firstResidual(int predictor){
+        return predictor == SWEEP_PREDICT_STEPS ? 1 : 0;
+    }
+
+    /*
+     * Sum of the folded residuals of probe with predictor.
+     */
+    uint32_t residualSum(const uint16_t* probe, const uint16_t* previous, size_t steps, int predictor){
+        uint32_t sum = 0;
+        for (size_t i = firstResidual(predictor); i < steps; i++){
+            sum += fold((int32_t)probe[i] - predict(probe, previous, i, predictor));
+        }
+        return sum;
+    }
+
+    /*
+     * Rice parameter for count residuals adding up to sum: the smallest k with count << k >= sum.
+     */
+    int riceParameter(uint32_t sum, size_t count){
+        int k = 0;
+        while (k < SWEEP_RICE_K_MAX && ((uint32_t)count << k) < sum) k++;
+        return k;
+    }
+
+    /*
+     * Bits into bytes, most significant first. Writes nothing past the end and remembers that it ran out.
+     */
+    class BitWriter {
+    private:
+        uint8_t* out;
+        uint8_t* end;
+        uint32_t pending;  // bits not written yet, in the low used bits
+        int used;
+        bool full;
+
+    public:
+        BitWriter(uint8_t* out, size_t capacity) : out(out), end(out + capacity), pending(0), used(0), full(false) {}
+
+        // At most 24 bits at a time
+        void put(uint32_t bits, int count){
+            pending = (pending << count) | (bits & ((1u << count) - 1));
+            used += count;
+            while (used >= 8){
+                used -= 8;
+                if (out == end){
+                    full = true;
+                    return;
+                }
+                *out++ = (uint8_t)(pending >> used);
+            }
+        }
+
+        void rice(uint32_t folded, int k){
+            uint32_t quotient = folded >> k;
+            if (quotient >= SWEEP_RICE_ESCAPE){
+                put((1u << SWEEP_RICE_ESCAPE) - 1, SWEEP_RICE_ESCAPE);
+                put(folded, SWEEP_RESIDUAL_BITS);
+                return;
+            }
+            // quotient 1 bits and a 0, then the low k bits
+            put(((1u << quotient) - 1) << 1, (int)quotient + 1);
+            if (k) put(folded, k);
+        }
+
+        /*
+         * Pads the last byte. Returns the bytes written, or 0 if they did not fit.
+         */
+        size_t finish(uint8_t* start){
+            if (!full && used) put(0, 8 - used);
+            return full ? 0 : out - start;
+        }
+    };
+}
+
+size_t sweepEncode(const uint16_t* sweep, size_t steps, size_t probes, uint8_t* out, size_t capacity){
+    BitWriter bits(out, capacity);
+    for (size_t p = 0; p < probes; p++){
+        const uint16_t* probe = sweep + p * steps;
+        const uint16_t* previous = p > 0 ? probe - steps : probe;  // only read for SWEEP_PREDICT_PROBE
+        int predictor = SWEEP_PREDICT_STEPS;
+        uint32_t sum = residualSum(probe, previous, steps, SWEEP_PREDICT_STEPS);
+        if (p > 0){
+            uint32_t across = residualSum(probe, previous, steps, SWEEP_PREDICT_PROBE);
+            if (across < sum){
+                predictor = SWEEP_PREDICT_PROBE;
+                sum = across;
+            }
+        }
+        size_t first = firstResidual(predictor);
+        int k = riceParameter(sum, steps - first);
+        bits.put(predictor, 1);
+        bits.put(k, SWEEP_RICE_K_BITS);
+        if (first) bits.put(probe[0], 16);
+        for (size_t i = first; i < steps; i++){
+            bits.rice(fold((int32_t)probe[i] - predict(probe, previous, i, predictor)), k);
+        }
+    }
+    return bits.finish(out);
+}
+
+#ifndef ARDUINO
+namespace {
+    /*
+     * Reads what BitWriter wrote. Reading past the end gives 0 bits and marks the stream bad.
+     */
+    class BitReader {
+    private:
+        const uint8_t* in;
+        const uint8_t* end;
+        uint32_t pending;
+        int left;  // bits in pending
+        bool bad;
+
+    public:
+        BitReader(const uint8_t* in, size_t length) : in(in), end(in + length), pending(0), left(0), bad(false) {}
+
+        // At most 24 bits at a time
+        uint32_t get(int count){
+            while (left < count){
+                if (in == end){
+                    bad = true;
+                    return 0;
+                }
+                pending = (pending << 8) | *in++;
+                left += 8;
+            }
+            left -= count;
+            return (pending >> left) & ((1u << count) - 1);
+        }
+
+        uint32_t rice(int k){
+            uint32_t quotient = 0;
+            while (quotient < SWEEP_RICE_ESCAPE && get(1)){
+                quotient++;
+            }
+            if (quotient == SWEEP_RICE_ESCAPE) return get(SWEEP_RESIDUAL_BITS);
+            return (quotient << k) | (k ? get(k) : 0);
+        }
+
+        /*
+         * Whether the stream ended exactly here, padding included, and nothing went wrong before.
+         */
+        bool done(){
+            return !bad && in == end && (pending & ((1u << left) - 1)) == 0;
+        }
+
+        bool failed() const { return bad; }
+    };
+}
+
+bool sweepDecode(const uint8_t* in, size_t length, size_t steps, size_t probes, uint16_t* sweep){
+    BitReader bits(in, length);
+    for (size_t p = 0; p < probes; p++){
+        uint16_t* probe = sweep + p * steps;
+        const uint16_t* previous = p > 0 ? probe - steps : probe;  // only read for SWEEP_PREDICT_PROBE
+        int predictor = (int)bits.get(1);
+        int k = (int)bits.get(SWEEP_RICE_K_BITS);
+        if (p == 0 && predictor == SWEEP_PREDICT_PROBE) return false;
+        size_t first = firstResidual(predictor);
+        if (first) probe[0] = (uint16_t)bits.get(16);
+        for (size_t i = first; i < steps; i++){
+            int32_t sample = predict(probe, previous, i, predictor) + unfold(bits.rice(k));
+            if (sample < 0 || sample > 0xFFFF || bits.failed()) return false;
+            probe[i] = (uint16_t)sample;
+        }
+    }
+    return bits.done();
+}
+#endif
@@ -0,0 +1,614 @@
+/**
+ * @file TelemetryDecoder.cpp
+ * @brief Ground side telemetry decoder. See TelemetryDecoder.hpp.
+ */
+#ifndef ARDUINO
+#include <TelemetryDecoder.hpp>
+#include <ReedSolomon.hpp>
+#include <SweepCodec.hpp>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#define DECODER_READ_CHUNK 65536
+// Records that have to check out back to back before the decoder trusts a sentinel it found by searching
+#define DECODER_RESYNC_RECORDS 2
+// Longest Framing::COBS packet, delimiter included
+#define DECODER_MAX_PACKET SweepRecord::framed_size
+// Longest Framing::REED_SOLOMON block, record and parity
+#define DECODER_MAX_BLOCK (SweepRecord::size + RS_PARITY)
+
+namespace {
+    template <class Record>
+    void takeSweep(SweepColumns& columns, const uint8_t* in){
+        size_t n = columns.size();
+        columns.time_stamp.resize(n + 1);
+        columns.shield_id.resize(n + 1);
+        columns.samples.resize((n + 1) * SweepColumns::SAMPLES);
+        Record::unpack(in, columns.time_stamp[n], columns.shield_id[n],
+                       *reinterpret_cast<uint16_t (*)[SweepColumns::SAMPLES]>(&columns.samples[n * SweepColumns::SAMPLES]));
+    }
+
+    /*
+     * A ##s or ##t record, decoded into the columns of ##S or ##T. false if the sweep does not decode.
+     */
+    template <class Record>
+    bool takeCodedSweep(SweepColumns& columns, const uint8_t* in){
+        size_t n = columns.size();
+        columns.time_stamp.resize(n + 1);
+        columns.shield_id.resize(n + 1);
+        columns.samples.resize((n + 1) * SweepColumns::SAMPLES);
+        const uint8_t* payload;
+        size_t length = Record::unpack(in, payload, columns.time_stamp[n], columns.shield_id[n]);
+        if (sweepDecode(payload, length, SWEEP_STEPS, SWEEP_PROBES, &columns.samples[n * SweepColumns::SAMPLES])) return true;
+        columns.time_stamp.resize(n);
+        columns.shield_id.resize(n);
+        columns.samples.resize(n * SweepColumns::SAMPLES);
+        return false;
+    }
+
+    template <class Record>
+    void takeImu(ImuColumns& columns, const uint8_t* in){
+        size_t n = columns.size();
+        columns.time_stamp.resize(n + 1);
+        columns.values.resize((n + 1) * ImuColumns::VALUES);
+        Record::unpack(in, columns.time_stamp[n],
+                       *reinterpret_cast<int16_t (*)[ImuColumns::VALUES]>(&columns.values[n * ImuColumns::VALUES]));
+    }
+
+    void takeHousekeeping(HousekeepingColumns& columns, const uint8_t* in){
+        size_t n = columns.size();
+        columns.time_stamp.resize(n + 1);
+        columns.counters.resize((n + 1) * HousekeepingColumns::COUNTERS);
+        HousekeepingRecord::unpack(in, columns.time_stamp[n], *reinterpret_cast<uint32_t (*)[HousekeepingColumns::COUNTERS]>(
+                                       &columns.counters[n * HousekeepingColumns::COUNTERS]));
+    }
+
+    /*
+     * Length of the record in starts, or 0 if in does not start with a sentinel or names a coded sweep longer than any.
+     * in has left bytes, at least TELEMETRY_SENTINEL_LEN. The length of a coded sweep is in its header, and until that has
+     * arrived this is the header length, so the caller waits for more.
+     */
+    size_t recordSize(const uint8_t* in, size_t left){
+        if (in[0] != '#' || in[1] != '#') return 0;
+        switch (in[2]){
+            case SweepRecord::id:       return SweepRecord::size;
+            case StoredSweepRecord::id: return StoredSweepRecord::size;
+            case ImuRecord::id:         return ImuRecord::size;
+            case StoredImuRecord::id:   return StoredImuRecord::size;
+            case HousekeepingRecord::id: return HousekeepingRecord::size;
+            case CodedSweepRecord::id:
+            case StoredCodedSweepRecord::id: {
+                if (left < CodedSweepRecord::header_size) return CodedSweepRecord::header_size;
+                size_t size = CodedSweepRecord::size(in);
+                return size <= CodedSweepRecord::max_size ? size : 0;
+            }
+            default:                    return 0;
+        }
+    }
+
+    /*
+     * Whether b is one of the record IDs.
+     */
+    inline bool isRecordId(uint8_t b){
+        return b == SweepRecord::id || b == StoredSweepRecord::id || b == ImuRecord::id || b == StoredImuRecord::id
+            || b == CodedSweepRecord::id || b == StoredCodedSweepRecord::id || b == HousekeepingRecord::id;
+    }
+
+    /*
+     * First sentinel at or after begin. If there is none, where a sentinel cut off by end could start ("#" or "##" as
+     * the last bytes), or end.
+     */
+    const uint8_t* findSentinelScalar(const uint8_t* begin, const uint8_t* end){
+        const uint8_t* p = begin;
+        while (end - p >= TELEMETRY_SENTINEL_LEN){
+            p = (const uint8_t*)memchr(p, '#', (end - p) - (TELEMETRY_SENTINEL_LEN - 1));
+            if (!p) break;
+            if (p[1] == '#' && isRecordId(p[2])) return p;
+            p++;
+        }
+        p = end - (TELEMETRY_SENTINEL_LEN - 1) > begin ? end - (TELEMETRY_SENTINEL_LEN - 1) : begin;
+        while (p < end && !(p[0] == '#' && (p + 1 == end || p[1] == '#'))) p++;
+        return p;
+    }
+
+#if defined(__SSE2__)
+    /*
+     * Sixteen positions at a time: '#' at p, '#' at p + 1 and an ID at p + 2, from three overlapping loads.
+     */
+    const uint8_t* findSentinelSse2(const uint8_t* begin, const uint8_t* end){
+        const __m128i hash = _mm_set1_epi8('#');
+        const __m128i s = _mm_set1_epi8(SweepRecord::id), t = _mm_set1_epi8(StoredSweepRecord::id);
+        const __m128i i = _mm_set1_epi8(ImuRecord::id), j = _mm_set1_epi8(StoredImuRecord::id);
+        const __m128i cs = _mm_set1_epi8(CodedSweepRecord::id), ct = _mm_set1_epi8(StoredCodedSweepRecord::id);
+        const __m128i h = _mm_set1_epi8(HousekeepingRecord::id);
+        const uint8_t* p = begin;
+        for (; end - p >= 16 + TELEMETRY_SENTINEL_LEN - 1; p += 16){
+            __m128i first = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)p), hash);
+            __m128i second = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(p + 1)), hash);
+            __m128i id = _mm_loadu_si128((const __m128i*)(p + 2));
+            __m128i ids = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(id, s), _mm_cmpeq_epi8(id, t)),
+                                       _mm_or_si128(_mm_cmpeq_epi8(id, i), _mm_cmpeq_epi8(id, j)));
+            ids = _mm_or_si128(ids, _mm_or_si128(_mm_cmpeq_epi8(id, cs), _mm_cmpeq_epi8(id, ct)));
+            ids = _mm_or_si128(ids, _mm_cmpeq_epi8(id, h));
+            int mask = _mm_movemask_epi8(_mm_and_si128(_mm_and_si128(first, second), ids));
+            if (mask) return p + __builtin_ctz(mask);
+        }
+        return findSentinelScalar(p, end);
+    }
+
+    /*
+     * findSentinelSse2, 32 positions at a time. Built for AVX2 whatever the compiler flags, and only called if the CPU
+     * has it.
+     */
+    __attribute__((target("avx2")))
+    const uint8_t* findSentinelAvx2(const uint8_t* begin, const uint8_t* end){
+        const __m256i hash = _mm256_set1_epi8('#');
+        const __m256i s = _mm256_set1_epi8(SweepRecord::id), t = _mm256_set1_epi8(StoredSweepRecord::id);
+        const __m256i i = _mm256_set1_epi8(ImuRecord::id), j = _mm256_set1_epi8(StoredImuRecord::id);
+        const __m256i cs = _mm256_set1_epi8(CodedSweepRecord::id), ct = _mm256_set1_epi8(StoredCodedSweepRecord::id);
+        const __m256i h = _mm256_set1_epi8(HousekeepingRecord::id);
+        const uint8_t* p = begin;
+        for (; end - p >= 32 + TELEMETRY_SENTINEL_LEN - 1; p += 32){
+            __m256i first = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)p), hash);
+            __m256i second = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(p + 1)), hash);
+            __m256i id = _mm256_loadu_si256((const __m256i*)(p + 2));
+            __m256i ids = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(id, s), _mm256_cmpeq_epi8(id, t)),
+                                          _mm256_or_si256(_mm256_cmpeq_epi8(id, i), _mm256_cmpeq_epi8(id, j)));
+            ids = _mm256_or_si256(ids, _mm256_or_si256(_mm256_cmpeq_epi8(id, cs), _mm256_cmpeq_epi8(id, ct)));
+            ids = _mm256_or_si256(ids, _mm256_cmpeq_epi8(id, h));
+            unsigned mask = (unsigned)_mm256_movemask_epi8(_mm256_and_si256(_mm256_and_si256(first, second), ids));
+            if (mask) return p + __builtin_ctz(mask);
+        }
+        return findSentinelSse2(p, end);
+    }
+
+    typedef const uint8_t* (*FindSentinel)(const uint8_t*, const uint8_t*);
+
+    FindSentinel pickFindSentinel(){
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2") ? findSentinelAvx2 : findSentinelSse2;
+    }
+
+    const FindSentinel findSentinel = pickFindSentinel();
+#else
+    const uint8_t* findSentinel(const uint8_t* begin, const uint8_t* end){
+        return findSentinelScalar(begin, end);
+    }
+#endif
+}
+
+namespace sentinel_search {
+    const uint8_t* scalar(const uint8_t* begin, const uint8_t* end){
+        return findSentinelScalar(begin, end);
+    }
+#if defined(__SSE2__)
+    const uint8_t* sse2(const uint8_t* begin, const uint8_t* end){
+        return findSentinelSse2(begin, end);
+    }
+
+    const uint8_t* avx2(const uint8_t* begin, const uint8_t* end){
+        return findSentinelAvx2(begin, end);
+    }
+
+    bool avx2_supported(){
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2");
+    }
+#endif
+}
+
+namespace {
+    /*
+     * Whether records records start at in back to back, each followed by the next sentinel, or by the end of the stream
+     * if final. 1 if they do, 0 if not, -1 if left is too short to tell yet. in starts with a sentinel.
+     */
+    int checkRecords(const uint8_t* in, size_t left, int records, bool final){
+        for (int r = 0; r < records; r++){
+            size_t size = recordSize(in, left);
+            if (size == 0) return 0;
+            if (left < size + TELEMETRY_SENTINEL_LEN){
+                if (!final) return -1;
+                return left >= size ? 1 : 0;
+            }
+            if (recordSize(in + size, left - size) == 0) return 0;
+            in += size;
+            left -= size;
+        }
+        return 1;
+    }
+
+    /*
+     * Framing::COBS: longest the ID and fields of record id can be, or 0 if id is not a record.
+     */
+    size_t payloadSize(uint8_t id){
+        switch (id){
+            case CodedSweepRecord::id:       return CodedSweepRecord::max_size - TELEMETRY_SENTINEL_LEN + 1;
+            case StoredCodedSweepRecord::id: return StoredCodedSweepRecord::max_size - TELEMETRY_SENTINEL_LEN + 1;
+            case SweepRecord::id:       return SweepRecord::size - TELEMETRY_SENTINEL_LEN + 1;
+            case StoredSweepRecord::id: return StoredSweepRecord::size - TELEMETRY_SENTINEL_LEN + 1;
+            case ImuRecord::id:         return ImuRecord::size - TELEMETRY_SENTINEL_LEN + 1;
+            case StoredImuRecord::id:   return StoredImuRecord::size - TELEMETRY_SENTINEL_LEN + 1;
+            case HousekeepingRecord::id: return HousekeepingRecord::size - TELEMETRY_SENTINEL_LEN + 1;
+            default:                    return 0;
+        }
+    }
+
+    void reserveSweeps(SweepColumns& columns, size_t records){
+        columns.time_stamp.reserve(records);
+        columns.shield_id.reserve(records);
+        columns.samples.reserve(records * SweepColumns::SAMPLES);
+    }
+
+    void reserveImu(ImuColumns& columns, size_t records){
+        columns.time_stamp.reserve(records);
+        columns.values.reserve(records * ImuColumns::VALUES);
+    }
+
+    bool writeSweeps(const SweepColumns& columns, const char* prefix, char id){
+        char path[512];
+        snprintf(path, sizeof(path), "%s%c.csv", prefix, id);
+        FILE* file = fopen(path, "w");
+        if (!file) return false;
+        fprintf(file, "time_stamp,shield_id");
+        for (size_t s = 0; s < SweepColumns::SAMPLES; s++) fprintf(file, ",s%zu", s);
+        fprintf(file, "\n");
+        for (size_t i = 0; i < columns.size(); i++){
+            fprintf(file, "%lu,%u", (unsigned long)columns.time_stamp[i], columns.shield_id[i]);
+            const uint16_t* samples = &columns.samples[i * SweepColumns::SAMPLES];
+            for (size_t s = 0; s < SweepColumns::SAMPLES; s++) fprintf(file, ",%u", samples[s]);
+            fprintf(file, "\n");
+        }
+        return fclose(file) == 0;
+    }
+
+    bool writeHousekeeping(const HousekeepingColumns& columns, const char* prefix){
+        char path[512];
+        snprintf(path, sizeof(path), "%s%c.csv", prefix, HousekeepingRecord::id);
+        FILE* file = fopen(path, "w");
+        if (!file) return false;
+        fprintf(file, "time_stamp");
+        for (size_t c = 0; c < HousekeepingColumns::COUNTERS; c++) fprintf(file, ",%s", counters::name((Counter)c));
+        fprintf(file, "\n");
+        for (size_t i = 0; i < columns.size(); i++){
+            fprintf(file, "%lu", (unsigned long)columns.time_stamp[i]);
+            const uint32_t* values = &columns.counters[i * HousekeepingColumns::COUNTERS];
+            for (size_t c = 0; c < HousekeepingColumns::COUNTERS; c++) fprintf(file, ",%lu", (unsigned long)values[c]);
+            fprintf(file, "\n");
+        }
+        return fclose(file) == 0;
+    }
+
+    bool writeImu(const ImuColumns& columns, const char* prefix, char id){
+        static const char* const NAMES[] = {"mag_x", "mag_y", "mag_z", "acc_x", "acc_y", "acc_z", "gyro_x", "gyro_y", "gyro_z"};
+        char path[512];
+        snprintf(path, sizeof(path), "%s%c.csv", prefix, id);
+        FILE* file = fopen(path, "w");
+        if (!file) return false;
+        fprintf(file, "time_stamp");
+        for (size_t v = 0; v < ImuColumns::VALUES; v++){
+            if (v < sizeof(NAMES) / sizeof(NAMES[0])) fprintf(file, ",%s", NAMES[v]);
+            else fprintf(file, ",spare%zu", v);
+        }
+        fprintf(file, "\n");
+        for (size_t i = 0; i < columns.size(); i++){
+            fprintf(file, "%lu", (unsigned long)columns.time_stamp[i]);
+            const int16_t* values = &columns.values[i * ImuColumns::VALUES];
+            for (size_t v = 0; v < ImuColumns::VALUES; v++) fprintf(file, ",%d", values[v]);
+            fprintf(file, "\n");
+        }
+        return fclose(file) == 0;
+    }
+}
+
+static_assert(DECODER_MAX_PACKET >= StoredSweepRecord::framed_size && DECODER_MAX_PACKET >= ImuRecord::framed_size
+              && DECODER_MAX_PACKET >= HousekeepingRecord::framed_size,
+              "DECODER_MAX_PACKET has to be the longest record");
+static_assert(StoredSweepRecord::size == SweepRecord::size && StoredImuRecord::size == ImuRecord::size,
+              "scan_blocks() tries one length per kind of record");
+static_assert(StoredCodedSweepRecord::header_size == CodedSweepRecord::header_size
+              && StoredCodedSweepRecord::max_size == CodedSweepRecord::max_size, "recordSize() reads both alike");
+
+TelemetryDecoder::TelemetryDecoder(Framing framing)
+    : out(), framing(framing), locked(false), dropping(false),
+      packet(DECODER_MAX_BLOCK > TELEMETRY_SENTINEL_LEN - 1 + DECODER_MAX_PACKET
+             ? DECODER_MAX_BLOCK : TELEMETRY_SENTINEL_LEN - 1 + DECODER_MAX_PACKET) {}
+
+void TelemetryDecoder::reserve(size_t bytes){
+    // Every cycle sends ##S and ##I, and ##T and ##J once replay starts
+    size_t cycles = bytes / (SweepRecord::size + ImuRecord::size) + 1;
+    reserveSweeps(out.sweeps, cycles);
+    reserveSweeps(out.stored_sweeps, cycles);
+    reserveImu(out.imu, cycles);
+    reserveImu(out.stored_imu, cycles);
+}
+
+void TelemetryDecoder::lose_sync(){
+    if (locked){
+        locked = false;
+        out.resyncs++;
+    }
+}
+
+/*
+ * Decodes one whole record. false if it is a coded sweep that does not decode, which is not taken.
+ */
+bool TelemetryDecoder::take(const uint8_t* in){
+    switch (in[2]){
+        case SweepRecord::id:       takeSweep<SweepRecord>(out.sweeps, in); break;
+        case StoredSweepRecord::id: takeSweep<StoredSweepRecord>(out.stored_sweeps, in); break;
+        case ImuRecord::id:         takeImu<ImuRecord>(out.imu, in); break;
+        case StoredImuRecord::id:   takeImu<StoredImuRecord>(out.stored_imu, in); break;
+        case HousekeepingRecord::id: takeHousekeeping(out.housekeeping, in); break;
+        case CodedSweepRecord::id:
+            if (!takeCodedSweep<CodedSweepRecord>(out.sweeps, in)) return false;
+            out.coded++;
+            break;
+        case StoredCodedSweepRecord::id:
+            if (!takeCodedSweep<StoredCodedSweepRecord>(out.stored_sweeps, in)) return false;
+            out.coded++;
+            break;
+    }
+    return true;
+}
+
+/*
+ * Decodes records from data. Returns how many bytes it used: everything, unless final is false and the end might be the
+ * start of a record, which is left for the next chunk.
+ */
+size_t TelemetryDecoder::scan(const uint8_t* data, size_t length, bool final){
+    switch (framing){
+        case Framing::COBS:         return scan_packets(data, length, final);
+        case Framing::REED_SOLOMON: return scan_blocks(data, length, final);
+        default:                    return scan_sentinels(data, length, final);
+    }
+}
+
+/*
+ * Checks and decodes one Framing::COBS packet, delimiter not included.
+ */
+void TelemetryDecoder::take_packet(const uint8_t* in, size_t length){
+    // The ID is the first data byte, right after the first code byte, unless the packet is too short to have one
+    size_t payload = length >= 2 && in[0] > 1 ? payloadSize(in[1]) : 0;
+    // Most corruption is caught here without decoding: the encoded length is fixed by the payload length to within one
+    // code byte per 254. Coded sweeps only have a longest payload, and their length field is checked once decoded.
+    size_t shortest = payload + CRC16_LEN + 1;
+    bool fixed = payload && !(in[1] == CodedSweepRecord::id || in[1] == StoredCodedSweepRecord::id);
+    packet[0] = '#';
+    packet[1] = '#';
+    int decoded = payload == 0 || (fixed && length < shortest)
+                  || length > shortest + (payload + CRC16_LEN) / (COBS_MAX_RUN - 1)
+                ? -1 : cobsDecode(in, length, &packet[TELEMETRY_SENTINEL_LEN - 1]);
+    size_t size = decoded < 0 ? 0 : decoded + TELEMETRY_SENTINEL_LEN - 1;
+    if (decoded < 0 || recordSize(&packet[0], size) != size || !take(&packet[0])){
+        out.rejected++;
+        out.skipped += length + 1;
+    }
+}
+
+size_t TelemetryDecoder::scan_packets(const uint8_t* data, size_t length, bool final){
+    size_t pos = 0;
+    while (pos < length){
+        const uint8_t* in = data + pos;
+        size_t left = length - pos;
+        const uint8_t* end = (const uint8_t*)memchr(in, COBS_DELIMITER, left);
+        if (!end){
+            // A packet cut off by the chunk, unless it is already longer than any packet can be. Then it is dropped up to
+            // the delimiter that ends it, in however many chunks that takes, and counted once.
+            size_t keep = final || dropping || left >= DECODER_MAX_PACKET ? 0 : left;
+            if (left > keep){
+                if (!dropping) out.rejected++;
+                dropping = !final;
+                out.skipped += left - keep;
+            }
+            return length - keep;
+        }
+        if (dropping){
+            out.skipped += (end - in) + 1;
+            dropping = false;
+        } else if (end > in){
+            take_packet(in, end - in);
+        }
+        pos += (end - in) + 1;
+    }
+    return pos;
+}
+
+/*
+ * Framing::REED_SOLOMON: copies the block of a record of the given size at in to packet and repairs it there. Returns the
+ * bytes corrected, or -1 if it could not be repaired into a record of that size.
+ */
+int TelemetryDecoder::repair(const uint8_t* in, size_t size){
+    memcpy(&packet[0], in, size + RS_PARITY);
+    int corrected = rsDecode(&packet[0], size + RS_PARITY);
+    return corrected >= 0 && recordSize(&packet[0], size) == size ? corrected : -1;
+}
+
+size_t TelemetryDecoder::scan_blocks(const uint8_t* data, size_t length, bool final){
+    static const size_t SIZES[] = { SweepRecord::size, ImuRecord::size, HousekeepingRecord::size };
+    size_t pos = 0;
+    while (pos < length){
+        const uint8_t* in = data + pos;
+        size_t left = length - pos;
+        if (left < TELEMETRY_SENTINEL_LEN){
+            if (!final) break;
+            lose_sync();
+            out.skipped += left;
+            return length;
+        }
+        // A readable sentinel says how long the block is. In sync, a block whose sentinel was hit is worth repairing too,
+        // trying each record length. Out of sync, only a readable sentinel is tried, and only half as many corrections
+        // are trusted, so the decoder does not lock onto data that happens to be close to a codeword.
+        size_t sizes[1 + sizeof(SIZES) / sizeof(SIZES[0])];
+        size_t tries = 0;
+        size_t named = recordSize(in, left);
+        if (named) sizes[tries++] = named;
+        for (size_t i = 0; locked && i < sizeof(SIZES) / sizeof(SIZES[0]); i++){
+            if (SIZES[i] != named) sizes[tries++] = SIZES[i];
+        }
+        int limit = locked ? RS_PARITY / 2 : RS_PARITY / 4;
+        bool waiting = false;
+        int corrected = -1;
+        size_t block = 0;
+        for (size_t t = 0; t < tries && corrected < 0; t++){
+            block = sizes[t] + RS_PARITY;
+            if (left < block){
+                waiting = !final;
+                if (waiting) break;
+                continue;
+            }
+            corrected = repair(in, sizes[t]);
+            if (corrected > limit) corrected = -1;
+        }
+        // A coded sweep can be any length up to its longest, so in sync the lengths tried for one are those the next
+        // sentinel (or the end of the stream) comes right after
+        if (locked && corrected < 0 && !waiting){
+            const size_t longest = CodedSweepRecord::max_size + RS_PARITY + TELEMETRY_SENTINEL_LEN;
+            waiting = !final && left < longest;
+            for (size_t size = CodedSweepRecord::header_size; !waiting && corrected < 0
+                 && size <= CodedSweepRecord::max_size; size++){
+                block = size + RS_PARITY;
+                if (size == named || block > left) continue;
+                bool next = block == left || (left - block >= TELEMETRY_SENTINEL_LEN && recordSize(in + block, left - block));
+                if (!next) continue;
+                corrected = repair(in, size);
+                if (corrected > limit) corrected = -1;
+            }
+        }
+        if (corrected >= 0 && take(&packet[0])){
+            out.corrected += corrected;
+            locked = true;
+            pos += block;
+            continue;
+        }
+        if (waiting) break;
+        if (locked) out.rejected++;
+        lose_sync();
+        size_t jump = findSentinel(in + 1, data + length) - in;
+        out.skipped += jump;
+        pos += jump;
+    }
+    return pos;
+}
+
+size_t TelemetryDecoder::scan_sentinels(const uint8_t* data, size_t length, bool final){
+    size_t pos = 0;
+    while (pos < length){
+        const uint8_t* in = data + pos;
+        size_t left = length - pos;
+        if (left < TELEMETRY_SENTINEL_LEN){
+            if (!final) break;
+            lose_sync();
+            out.skipped += left;
+            return length;
+        }
+        // A record only counts if the next one starts right after it (or the stream ends there). After losing sync, the
+        // one after that has to check out too, so a "##S" in the data is not enough to lock on.
+        int check = checkRecords(in, left, locked ? 1 : DECODER_RESYNC_RECORDS, final);
+        if (check < 0) break;
+        if (check == 0 || !take(in)){
+            lose_sync();
+            size_t jump = findSentinel(in + 1, data + length) - in;
+            out.skipped += jump;
+            pos += jump;
+            continue;
+        }
+        locked = true;
+        pos += recordSize(in, left);
+    }
+    return pos;
+}
+
+void TelemetryDecoder::feed(const uint8_t* data, size_t length){
+    out.bytes += length;
+    if (carry.empty()){
+        size_t used = scan(data, length, false);
+        carry.assign(data + used, data + length);
+        return;
+    }
+    // Finish the record the last chunk cut off, then go back to decoding in place
+    size_t had = carry.size();
+    const size_t longest = SweepRecord::size + TELEMETRY_SENTINEL_LEN > DECODER_MAX_PACKET
+                         ? SweepRecord::size + TELEMETRY_SENTINEL_LEN : DECODER_MAX_PACKET;
+    const size_t blocks = DECODER_MAX_BLOCK + TELEMETRY_SENTINEL_LEN;
+    const size_t record = longest > blocks ? longest : blocks;
+    size_t borrow = length < record ? length : record;
+    carry.insert(carry.end(), data, data + borrow);
+    size_t used = scan(carry.data(), carry.size(), false);
+    if (used < had){
+        // Still not enough for a record, keep waiting
+        carry.erase(carry.begin(), carry.begin() + used);
+        carry.insert(carry.end(), data + borrow, data + length);
+        return;
+    }
+    carry.clear();
+    size_t resume = used - had;
+    used = scan(data + resume, length - resume, false);
+    carry.assign(data + resume + used, data + length);
+}
+
+void TelemetryDecoder::finish(){
+    scan(carry.data(), carry.size(), true);
+    carry.clear();
+}
+
+bool decodeFile(const char* path, TelemetryDecoder& decoder){
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+    struct stat info;
+    if (fstat(fd, &info) < 0){
+        int error = errno;
+        close(fd);
+        errno = error;
+        return false;
+    }
+    if (S_ISREG(info.st_mode)){
+        size_t length = (size_t)info.st_size;
+        if (length > 0){
+            void* map = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (map == MAP_FAILED){
+                int error = errno;
+                close(fd);
+                errno = error;
+                return false;
+            }
+            madvise(map, length, MADV_SEQUENTIAL);
+            decoder.reserve(length);
+            decoder.feed((const uint8_t*)map, length);
+            munmap(map, length);
+        }
+    } else {
+        // Serial port, pty or pipe: decode as it arrives
+        std::vector<uint8_t> chunk(DECODER_READ_CHUNK);
+        for (;;){
+            ssize_t n = read(fd, chunk.data(), chunk.size());
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0){
+                int error = errno;
+                close(fd);
+                errno = error;
+                return false;
+            }
+            if (n == 0) break;
+            decoder.feed(chunk.data(), (size_t)n);
+        }
+    }
+    close(fd);
+    decoder.finish();
+    return true;
+}
+
+bool writeCsv(const DecodedTelemetry& telemetry, const char* prefix){
+    return writeSweeps(telemetry.sweeps, prefix, SweepRecord::id)
+        && writeImu(telemetry.imu, prefix, ImuRecord::id)
+        && writeSweeps(telemetry.stored_sweeps, prefix, StoredSweepRecord::id)
+        && writeImu(telemetry.stored_imu, prefix, StoredImuRecord::id)
+        && writeHousekeeping(telemetry.housekeeping, prefix);
+}
+#endif
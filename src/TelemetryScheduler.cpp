@@ -0,0 +1,27 @@
+/**
+ * @file TelemetryScheduler.cpp
+ * @brief Per cycle UART budget for live and replayed records. See TelemetryScheduler.hpp.
+ */
+#include <TelemetryScheduler.hpp>
+
+TelemetryScheduler::TelemetryScheduler(uint32_t baud, uint32_t period_us)
+    : bytes_per_second(baud / UART_BITS_PER_BYTE), period_us(period_us), left(0), backlog(0), backlog_us(0),
+      measured(false), drain_sum(0), replayed(0)
+{}
+
+void TelemetryScheduler::begin(uint32_t pending, uint32_t elapsed_us, uint32_t backlog, uint32_t now_us){
+    // The UART keeps sending until the next cycle starts, anything past that comes out of the next frame's budget
+    uint32_t until_next = elapsed_us < period_us ? period_us - elapsed_us : 0;
+    uint32_t drained = (uint32_t)((uint64_t)until_next * bytes_per_second / 1000000);
+    uint32_t carried = pending > drained ? pending - drained : 0;
+    left = (int32_t)budget() - (int32_t)carried;
+
+    uint32_t interval = now_us - backlog_us;
+    if (measured && interval > 0){
+        int32_t rate = (int32_t)(((int64_t)this->backlog - backlog) * 1000000 / interval);
+        drain_sum += rate - drain_sum / SCHEDULER_DRAIN_SMOOTHING;
+    }
+    this->backlog = backlog;
+    backlog_us = now_us;
+    measured = true;
+}
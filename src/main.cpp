@@ -39,22 +39,28 @@ The documentation is maintained with Doxygen. A workflow in the main branch auto
  */
 
 //========== Libraries ==========//
-#include <Arduino.h>
+#include <HAL.hpp> // all board access goes through the HAL so this file also builds on the host
 #include <Pip.hpp> //note, Max1148 isn't included because it's included in Pip
 #include <PDC.hpp>
 #include <AT25M02.hpp>
 #include <PipController.hpp>
+#include <SweepConfig.hpp> // SWEEP_STEPS, SWEEP_AVERAGES and the Pip types they size
+#include <FSM.hpp>
+#include <Telemetry.hpp> // record layouts, see Telemetry.hpp
+#include <TelemetryScheduler.hpp>
+#include <Counters.hpp> // housekeeping counters, sent as ##H
 //========== For IMU ==========//
-#include <IMU.hpp> // Library to initialize and sample IMU
-#include <Wire.h>  // I2C communications
-#include <LSM6.h>  // Library for the gyro/accelerometer
-#include <LIS3MDL.h> // Library for the LIS3MDL 3-axis magnetometer
+#include <IMU.hpp> // Library to initialize and sample IMU. Pulls in LSM6 (gyro/accelerometer) and LIS3MDL (magnetometer)
 
 //========== Timing ==========//
 // SAMPLE_PERIOD defined in sweep_values_v5.1h
 #define BUFFER  1000  // buffer to wait period of missed measurement
 #define SWEEP_OFFSET           500
 #define RAM_BUFFER_DELAY 10  // Delay in seconds until the chip starts sending saved data.
+#define UART_BAUD 230400
+#ifndef HOUSEKEEPING_CYCLES
+#define HOUSEKEEPING_CYCLES 45  // cycles between ##H housekeeping records, about a second
+#endif
 
 //========== Debugging ==========//
 void blink();
@@ -62,7 +68,7 @@ bool debug = false;
 int cycle_counter = 0;
 
 //========== Sweep Parameters ==========//
-#define SWEEP_STEPS        28               // Number of steps in sweep
+// SWEEP_STEPS and SWEEP_AVERAGES are in SweepConfig.hpp
 // Sweep range set with SHIELD_NUMBER in sweep_values_v5_1.h
 #define SHIELD_NUMBER 5
 #include "sweep_values_v5_1.h"
@@ -73,7 +79,32 @@ int cycle_counter = 0;
 // Adding 124 us delay to make it 200 us between DAC and ADC.
 
 #define SWEEP_DELAY            46.875          // Old version was 1500 clock cycles on a 32 MHz processor. comes out to this in us
-#define SWEEP_AVERAGES         8           // each sample ~20-21 us
+#ifndef SWEEP_ADC_TRANSPORT
+#define SWEEP_ADC_TRANSPORT    AdcTransport::GPIO_CS  // AdcTransport::HW_CS16 for NPCS chip select and 16-bit frames (not bench-tested on a Due yet), see Max1148.hpp
+#endif
+#ifndef SWEEP_ACQUISITION
+#define SWEEP_ACQUISITION      Acquisition::POLLED  // Acquisition::DMA streams each step over the DMAC (not bench-tested on a Due yet), see PipController.hpp
+#endif
+#ifndef SWEEP_DAC_STEPPING
+#define SWEEP_DAC_STEPPING     DacStepping::CPU  // dac_write + delay, DacStepping::TIMER for TC triggered DACC steps (not bench-tested on a Due yet)
+#endif
+// Step length when the timer steps the DACs: pip2's DAC conversion, SWEEP_DELAY settling and the ADC reads have to fit.
+// The default keeps the sweep duration above, and so the payload rotation per sweep.
+#ifndef SWEEP_STEP_PERIOD
+#define SWEEP_STEP_PERIOD      401         // us, 28 steps is 11.23 ms
+#endif
+#ifndef TELEMETRY_FRAMING
+#define TELEMETRY_FRAMING      Framing::SENTINEL  // Framing::COBS for COBS records with a CRC-16, Framing::REED_SOLOMON for FEC, see Telemetry.hpp
+#endif
+#ifndef SWEEP_CODING
+#define SWEEP_CODING           SweepCoding::RAW  // SweepCoding::RICE for ##s/##t predictive Rice coded sweeps, see SweepCodec.hpp
+#endif
+#ifndef EEPROM_TRANSPORT
+#define EEPROM_TRANSPORT       EepromTransport::GPIO_CS  // blocking SPI, EepromTransport::HW_CS_DMA streams page programs over the DMAC (not bench-tested on a Due yet), needs -DAT25M02_DMA=1, see AT25M02.hpp
+#endif
+#ifndef SWEEP_CONVERSION
+#define SWEEP_CONVERSION       Conversion::SINGLE  // 24 SPI clocks per sample, Conversion::PIPELINED for 16 (not bench-tested on a Due yet)
+#endif
 
 //========== Class Declarations ==========//
 PDC pdc;
@@ -81,54 +112,89 @@ PDC pdc;
 Max1148 adc0(Channel::CHAN2);
 Max1148 adc1(Channel::CHAN1);
 
-Pip pip0(SWEEP_DELAY, SWEEP_AVERAGES, SWEEP_STEPS, 339, 3752, DAC0, adc0);
-Pip pip1(SWEEP_DELAY, SWEEP_AVERAGES, SWEEP_STEPS, 339, 3752, DAC1, adc1);
-PipController pipController(pip0, pip1);
+SweepPip pip0(SWEEP_DELAY, SweepTable<339, 3752, SWEEP_STEPS>::codes, DAC0, adc0);
+SweepPip pip1(SWEEP_DELAY, SweepTable<339, 3752, SWEEP_STEPS>::codes, DAC1, adc1);
+SweepController pipController(pip0, pip1);
 
 LIS3MDL compass;
 LSM6 gyro;
 AT25M02 ram;
+TelemetryScheduler scheduler(UART_BAUD, SAMPLE_PERIOD);
 
 //========== Sweep Variable ==========//
 uint8_t shieldID = 60;
 
 //========== Buffers and Messaging ==========//
-int16_t IMUData[10];
-uint32_t IMUTimeStamp;
-uint32_t *p_IMUTimeStamp = &IMUTimeStamp;
-// Use J & T for buffered messages (sentinel + 1)
-uint8_t sweepSentinel[3] = {'#', '#', 'S'};       // 3 bytes: "##S"
-uint8_t sweepSentinelBuf[3] = {'#', '#', 'T'};    // 3 bytes: "##T"
-uint8_t imuSentinel[3] = {'#', '#', 'I'};
-uint8_t imuSentinelBuf[3] = {'#', '#', 'J'};
+// Records and their sentinels are declared in Telemetry.hpp. Use J & T for buffered messages (sentinel + 1)
 
 bool savedSweep = false;		// If we have a saved sweep to send
 bool sendFromRam = false;		// When to send from ram
 bool storeToRam = true;			// Save data to the ram chip
 
-//buffer for combined sweep data
-uint16_t sweep_buffer[2*SWEEP_STEPS]; //112 bytes
-
-
 
 //========== Main Loop Timing ==========//
 uint32_t startTime = 0;
 uint32_t sweepStartTime = 0;
 uint32_t sweepTimeStamp = 0;
-uint32_t *p_sweepTimeStamp = &sweepTimeStamp;
 
 //========== Buffer for Ram ==========//
-#define IMU_TIMESTAMP_OFFSET 0
-#define IMU_DATA_OFFSET     (sizeof(IMUTimeStamp) + IMU_TIMESTAMP_OFFSET)
-#define SWEEP_TIMESTAMP_OFFSET (sizeof(IMUData) + IMU_DATA_OFFSET)
-#define SWEEP_DATA_OFFSET (sizeof(sweepTimeStamp) + SWEEP_TIMESTAMP_OFFSET)
-#define RAM_BUF_LEN  (sizeof(IMUTimeStamp) + sizeof(IMUData) + sizeof(sweepTimeStamp) + sizeof(sweep_buffer)) //140 bytes, plus 7 bytes for sentinels/id
-// Stores the IMU data then the Sweep data
-uint8_t ramBuf[RAM_BUF_LEN];
-
-const size_t totalSize = 294;
-uint8_t memory_block[totalSize];
-uint8_t* p_memory_block = memory_block;
+// One stored cycle, laid out as StoredCycle in Telemetry.hpp
+#define RAM_BUF_LEN  StoredCycle::size //140 bytes, plus 7 bytes for sentinels/id
+
+// Most stored cycles one frame replays, when the scheduler has room for them and the backlog is above REPLAY_KEEP_BYTES
+#ifndef REPLAY_MAX
+#define REPLAY_MAX 4
+#endif
+// Backlog extra replays leave in the EEPROM. One record a cycle is replayed whatever the backlog, and the extra ones
+// drain it as fast as the link allows down to this. 0 empties it. Set it to RAM_BUFFER_DELAY's worth of cycles,
+// (RAM_BUFFER_DELAY * 1000000UL / SAMPLE_PERIOD * RAM_BUF_LEN), to keep replayed data that far behind live so a drop
+// out does not lose both - but replay starts with exactly that much stored, so then the backlog never drains.
+#ifndef REPLAY_KEEP_BYTES
+#define REPLAY_KEEP_BYTES 0
+#endif
+#define FRAME_RECORDS (3 + 2 * REPLAY_MAX)  // ##S, ##I and ##H, then ##J and ##T for each replay
+// Longest frame with Framing::COBS
+#define FRAMED_LEN (SweepRecord::framed_size + ImuRecord::framed_size + HousekeepingRecord::framed_size \
+                    + REPLAY_MAX * (StoredImuRecord::framed_size + StoredSweepRecord::framed_size))
+// Replay records on the link, the sweep raw, so the scheduler only reads one from the EEPROM if it is sure to fit
+#define REPLAY_WIRE_MAX (wireSize(TELEMETRY_FRAMING, StoredImuRecord::size) + wireSize(TELEMETRY_FRAMING, StoredSweepRecord::size))
+
+/**
+ * @brief Everything one cycle sends, each field in the buffer it is sent from.
+ * The sweep, the IMU sample and the record read back from the EEPROM are written here during a cycle, and sendData()
+ * hands the PDC a list of segments pointing at them (and at the sentinels and shieldID) at the start of the next. Nothing
+ * is packed into a staging buffer.
+ */
+struct CycleData {
+    uint32_t sweepTimeStamp;            // live ##S timestamp, set by sendData()
+    uint16_t sweep[SweepController::SWEEP_SAMPLES];
+    uint32_t IMUTimeStamp;
+    int16_t IMUData[IMU_VALUES];
+    alignas(uint32_t) uint8_t ramBuf[REPLAY_MAX][RAM_BUF_LEN];  // StoredCycles, each sent as ##J and ##T
+    uint8_t replays;                    // how many of ramBuf readData() filled
+    CodedSweep sweepCoded;              // sweep coded for SweepCoding::RICE, length 0 to send it raw
+    CodedSweep ramSweepCoded[REPLAY_MAX];  // the same for each ramBuf's sweep
+    bool housekeeping;                  // this frame carries ##H
+    uint32_t housekeepingTimeStamp;     // ##H timestamp and counters, copied in by sendData()
+    uint32_t counters[NUM_COUNTERS];
+    uint8_t framed[FRAMED_LEN];         // the records encoded for Framing::COBS
+    uint8_t parity[FRAME_RECORDS][RS_PARITY];  // each record's parity for Framing::REED_SOLOMON
+};
+// Ping-pong. The PDC sends one while the next cycle fills the other. One is sent at the start of a cycle and not written
+// again until the start of the next one, and at 230.4 kb/s its frame is on the wire for ~13 ms.
+CycleData cycles[2];
+uint8_t cycleSlot = 0;  // slot this cycle writes to, the next one sendData() sends
+// Segments in the longest frame: live ##S (or ##s), ##I and ##H records, then the replayed ##J and ##T (or ##t) ones, and
+// their parity
+#define SWEEP_SEGMENTS (CodedSweepRecord::segments > SweepRecord::segments ? CodedSweepRecord::segments : SweepRecord::segments)
+#define FRAME_SEGMENTS ((1 + REPLAY_MAX) * SWEEP_SEGMENTS + ImuRecord::segments + HousekeepingRecord::segments \
+                        + REPLAY_MAX * StoredImuRecord::segments + FRAME_RECORDS)
+static_assert(TELEMETRY_FRAMING != Framing::REED_SOLOMON || SweepRecord::size + RS_PARITY <= RS_BLOCK_MAX,
+              "Framing::REED_SOLOMON protects each record as one block");
+static_assert(RAM_BUF_LEN % alignof(uint32_t) == 0, "each ramBuf has to be as aligned as the first");
+static_assert(2 * FRAME_SEGMENTS <= PDC_TX_QUEUE_LEN, "the PDC has to hold a frame still going out and the next one");
+static_assert(AT25M02_DMA || EEPROM_TRANSPORT != EepromTransport::HW_CS_DMA, "EepromTransport::HW_CS_DMA needs -DAT25M02_DMA=1");
+uint32_t housekeepingCountdown = HOUSEKEEPING_CYCLES;  // cycles until the next ##H
 //========== Interrupt Timing ==========//
 #define SYNC_PIN 53
 volatile uint32_t timer;
@@ -136,26 +202,13 @@ volatile bool syncPulse;
 volatile bool newCycle;
 void configureTimerInterrupt();
 void syncHandler();
+void uartHandler();
 
-//========== Finite State Machine States ==========//
-enum BobState {
-	idle,
-	startSweep,
-	sendSweep,
-	takeIMU,
-	sendIMU,
-	sendStored,
-	sendTimeStamps,
-	waitForNewCycle,
-	interrupted,
-    store,
-    read
-};
+//========== Finite State Machine ==========//
+// States are in FSM.hpp
 BobState currentState = idle;
 
 //FSM function prototypes
-void FSMUpdate();
-void FSMAction();
 void startSweepOnShield();
 void sendIMUData();
 void sendSweepData();
@@ -164,6 +217,8 @@ void sendStoredData();
 void storeData();
 void readData();
 void sendData();
+TxSegment* addParity(TxSegment* record, TxSegment* end, uint8_t (&parity)[RS_PARITY]);
+void codeSweep(const uint16_t (&sweep)[SweepController::SWEEP_SAMPLES], CodedSweep& coded);
 
 bool isFirst = true;
 
@@ -171,45 +226,55 @@ void setup() {
 	if(debug){
       	// Configure serial, 230.4 kb/s baud rate
         //12.4 ms per message
-		Serial.begin(230400); 
+		hal::uart_begin(UART_BAUD); 
 		// Setup IMU
 		initIMU(&compass, &gyro);
 
 
 		// Setup PDC
+		hal::uart_attach_interrupt(uartHandler);
 		pdc.init();
-        SPI.begin();
+        hal::spi_begin();
 
 		// Initialize time
 		//startTime = micros();  
     }    
 	else{
 		// Configure serial, 230.4 kb/s baud rate
-        delay(200);
-        pinMode(LED_BUILTIN, OUTPUT);
-        digitalWrite(LED_BUILTIN, LOW);
+        hal::delay_ms(200);
+        hal::pin_mode(LED_BUILTIN, OUTPUT);
+        hal::digital_write(LED_BUILTIN, LOW);
 
-		Serial.begin(230400); 
+		hal::uart_begin(UART_BAUD); 
 		// Setup IMU
 		initIMU(&compass, &gyro);
 
-        SPI.begin();
+        hal::spi_begin();
+        adc0.set_transport(SWEEP_ADC_TRANSPORT);
+        adc1.set_transport(SWEEP_ADC_TRANSPORT);
+        pipController.set_acquisition(SWEEP_ACQUISITION, SWEEP_CONVERSION);
+        pipController.set_dac_stepping(SWEEP_DAC_STEPPING, SWEEP_STEP_PERIOD);
 
 		// Setup RAM
 		ram.init();
+		ram.set_transport(EEPROM_TRANSPORT);
 
 		// Setup PDC - must be called after Serial.begin()
+		hal::uart_attach_interrupt(uartHandler);
 		pdc.init();
 
 		// Initialize time
-		startTime = micros(); 
+		startTime = hal::micros(); 
 
 		// Configure the timer interrupt
 		configureTimerInterrupt();
+        if (TELEMETRY_FRAMING == Framing::REED_SOLOMON || SWEEP_CODING == SweepCoding::RICE){
+            hal::cycle_counter_begin();  // for COUNTER_FEC_MAX_CYCLES and COUNTER_CODING_MAX_CYCLES
+        }
 		//configure the external interrupt
-        pinMode(SYNC_PIN, INPUT_PULLUP);
-		attachInterrupt(digitalPinToInterrupt(SYNC_PIN), syncHandler, FALLING);
-        pinMode(7, OUTPUT);
+        hal::pin_mode(SYNC_PIN, INPUT_PULLUP);
+		hal::attach_interrupt(SYNC_PIN, syncHandler, FALLING);
+        hal::pin_mode(7, OUTPUT);
         
 	}
 }
@@ -218,7 +283,7 @@ void loop() {
 	if(debug){
         takeIMUData();
         //sendIMUData();
-        delay(500);
+        hal::delay_ms(500);
  	}
 	else{
             FSMUpdate();
@@ -239,17 +304,16 @@ void FSMUpdate(){
             syncPulse = false;
             return;
         }
-        volatile uint32_t irq_state = __get_PRIMASK();  
-        __disable_irq();                       
-        if (micros() - timer > SWEEP_OFFSET) {
+        hal::IrqState irq_state = hal::irq_save();
+        if (hal::micros() - timer > SWEEP_OFFSET) {
             if (isFirst){
                 isFirst = false;
-                timer = micros();
+                timer = hal::micros();
                 newCycle = false;
             }  
             currentState = startSweep;
         }
-        __set_PRIMASK(irq_state);  
+        hal::irq_restore(irq_state);
         break;
     }
 
@@ -257,6 +321,7 @@ void FSMUpdate(){
         if (syncPulse) {
             currentState = interrupted;
             syncPulse = false;
+            counters::add(COUNTER_FSM_INTERRUPTS);
         } else {
             currentState = takeIMU;
         }
@@ -267,6 +332,7 @@ void FSMUpdate(){
         if (syncPulse) {
             currentState = interrupted;
             syncPulse = false;
+            counters::add(COUNTER_FSM_INTERRUPTS);
         } else {
             currentState = read;
         }
@@ -276,6 +342,7 @@ void FSMUpdate(){
             if (syncPulse) {
                 currentState = interrupted;
                 syncPulse = false;
+                counters::add(COUNTER_FSM_INTERRUPTS);
             } else {
                 currentState = store;
             }
@@ -284,6 +351,7 @@ void FSMUpdate(){
         if (syncPulse) {
             currentState = interrupted;
             syncPulse = false;
+            counters::add(COUNTER_FSM_INTERRUPTS);
         } else {
             currentState = waitForNewCycle;
         }
@@ -371,6 +439,7 @@ void FSMAction(){
 			//sendStoredData();
 			break;
 		case waitForNewCycle:
+			ram.poll();  // program any page storeData() left waiting for the EEPROM
 			break;
         case store:
             storeData();
@@ -390,10 +459,10 @@ void FSMAction(){
  * @brief Blinks the onboard LED. Used for debugging.
  */
 void blink(){
-  digitalWrite(LED_BUILTIN, HIGH);
-  delay(200);
-  digitalWrite(LED_BUILTIN, LOW);
-  delay(200);
+  hal::digital_write(LED_BUILTIN, HIGH);
+  hal::delay_ms(200);
+  hal::digital_write(LED_BUILTIN, LOW);
+  hal::delay_ms(200);
 }
 
 /**
@@ -405,180 +474,223 @@ void TC0_Handler(){
         goLow=false;
     } 
   // Clear the status register. This is necessary to prevent the interrupt from being called repeatedly.
-  TC_GetStatus(TC0, 0);
+  hal::tick_timer_ack();
   
-  if (micros() - timer >= SAMPLE_PERIOD) {
+  if (hal::micros() - timer >= SAMPLE_PERIOD) {
         goLow=true; 
+        // waitForNewCycle clears newCycle, so if it is still set the state machine never got to the last one
+        if (newCycle) counters::add(COUNTER_MISSED_CYCLES);
 		newCycle = true;
-		timer = micros();
+		timer = hal::micros();
+        counters::add(COUNTER_TIMER_CYCLES);
 	}
 }
 
+/**
+ * @brief Interrupt handler for the UART, attached in setup(). The PDC driver uses it to chain queued frames, see PDC.hpp.
+ */
+void uartHandler(){
+    pdc.UART_Handler();
+}
+
+/**
+ * @brief Interrupt handler for the DMAC. Only the EEPROM asks for it, when a page has finished streaming to the chip.
+ */
+void DMAC_Handler(){
+    ram.DMAC_Handler();
+}
+
 void syncHandler(){
-    timer = micros();
+    timer = hal::micros();
 	syncPulse = true;
+    counters::add(COUNTER_SYNC_PULSES);
 }
 
 /**
  * @brief Configures timer counter for interrupt
- * Documentation for internal functions - see tc.c (system/libsam/source/tc.c at https://github.com/swallace23/framework-arduino-sam)
  * The processor has 3 clocks, each have 3 channels and 3 registers (RA, RB, RC).
  * This is set up to use TC0 and channel 0. RC is used to store the compare value.
  * The interrupt is triggered when the counter reaches the compare value. Calculate interrupt frequency with:
  * interrupt frequency = clock frequency / (RC+1)
- * Note that the clock frequency for TC0 is configured to be 656.25 kHz.
+ * Note that the clock frequency for TC0 is configured to be 656.25 kHz. Register setup is in hal::tick_timer_begin().
  */
 void configureTimerInterrupt(){
-  // Enable the clock to the TC0 peripheral
-  pmc_enable_periph_clk(ID_TC0);
-
-  /*Configures the timer:
-    - First two parameters set it to RC compare waveform mode. This means the timer resets when it reaches the value in RC.
-    - The third parameter sets the clock source to MCK/128. MCK is at 84 MHz, so this sets the clock to 656.25 kHz.
-  */
-  TC_Configure(TC0, 0, TC_CMR_WAVE | TC_CMR_WAVSEL_UP_RC | TC_CMR_TCCLKS_TIMER_CLOCK4);
   //RC sets the value that the counter reaches before triggering the interrupt
-  //This sets it to 10kHz
-  TC_SetRC(TC0, 0, 64.625); // 
-
-  // Enable the interrupt RC compare interrupt
-  TC0->TC_CHANNEL[0].TC_IER = TC_IER_CPCS;
-  // Disable all other TC0 interrupts
-  TC0->TC_CHANNEL[0].TC_IDR = ~TC_IER_CPCS;
-  NVIC_EnableIRQ(TC0_IRQn);
-  NVIC_SetPriority(TC0_IRQn, 0);
-
-  TC_Start(TC0, 0);
+  //This sets it to 10kHz (TC_SetRC takes an integer, so this was always 64)
+  hal::tick_timer_begin(64);
 }
 
 
  
 /**
- * @brief Attaches last data buffer to UART PDC, runs DAC sweep, and saves pip data into a combined buffer.
+ * @brief Queues last cycle's frame on the UART PDC, runs DAC sweep straight into this cycle's buffers.
  */
 void startSweepOnShield(){
     //take timestamp
     int lastTime = sweepTimeStamp;
-	sweepStartTime = micros();
+	sweepStartTime = hal::micros();
 	sweepTimeStamp = sweepStartTime - startTime;
     //this was here for debugging state machine timing discontinuities
      if(sweepTimeStamp-lastTime<22000){
-        pinMode(6, OUTPUT);
-        digitalWrite(6, HIGH);
+        hal::pin_mode(6, OUTPUT);
+        hal::digital_write(6, HIGH);
     }
     else{
-        pinMode(6, OUTPUT);
-        digitalWrite(6, LOW);
+        hal::pin_mode(6, OUTPUT);
+        hal::digital_write(6, LOW);
     } 
     sendData();
-	pipController.sweep();
-    memcpy(sweep_buffer, pip0.data, SWEEP_STEPS*sizeof(uint16_t));
-    //copy pip data into combined buffer
-    memcpy(sweep_buffer + SWEEP_STEPS, pip1.data, SWEEP_STEPS*sizeof(uint16_t));
+    //the slot just handed to the PDC is left alone, this cycle fills the other one
+    cycleSlot ^= 1;
+    //only waits if the UART has fallen a whole cycle behind
+    while (pdc.is_queued(&cycles[cycleSlot], sizeof(CycleData))){
+        hal::delay_us(100);
+    }
+    cycles[cycleSlot].replays = 0;
+    cycles[cycleSlot].housekeeping = --housekeepingCountdown == 0;
+    if (cycles[cycleSlot].housekeeping) housekeepingCountdown = HOUSEKEEPING_CYCLES;
+	pipController.sweep(cycles[cycleSlot].sweep);
+    codeSweep(cycles[cycleSlot].sweep, cycles[cycleSlot].sweepCoded);
     savedSweep=true;
 }
 
 
 void takeIMUData(){
-    IMUTimeStamp = micros() - startTime;
-    sampleIMU(&compass, &gyro, IMUData);
+    cycles[cycleSlot].IMUTimeStamp = hal::micros() - startTime;
+    sampleIMU(&compass, &gyro, cycles[cycleSlot].IMUData);
 }
 
 void storeData(){
     if (storeToRam){
-        ram.writeData((uint8_t *)&IMUTimeStamp, sizeof(IMUTimeStamp));
-        ram.writeData((uint8_t *)IMUData, sizeof(IMUData));
-        ram.writeData((uint8_t *)&sweepTimeStamp, sizeof(sweepTimeStamp));
-        ram.writeData((uint8_t *)sweep_buffer, sizeof(sweep_buffer));
+        CycleData& data = cycles[cycleSlot];
+        TxSegment fields[StoredCycle::fields];
+        StoredCycle::gather(fields, data.IMUTimeStamp, data.IMUData, sweepTimeStamp, data.sweep);
+        // One record: a full EEPROM drops the whole cycle, never the tail of it
+        ram.writeData(fields, StoredCycle::fields);
     }
 }
 
+/**
+ * @brief Plans the frame the next cycle sends: this cycle's live records, then as many stored cycles as the scheduler
+ * finds room for, read from the EEPROM now so sendData() only has to point at them.
+ */
 void readData(){
-    if(sendFromRam){
-        ram.readData(ramBuf, RAM_BUF_LEN);
+    if(!sendFromRam){
+        return;
+    }
+    CycleData& data = cycles[cycleSlot];
+    uint32_t backlog = ram.usedBytes();
+    scheduler.begin(pdc.pending_bytes(), hal::micros() - timer, backlog, hal::micros());
+    size_t live = data.sweepCoded.length ? CodedSweepRecord::header_size + data.sweepCoded.length : SweepRecord::size;
+    scheduler.take(wireSize(TELEMETRY_FRAMING, live) + wireSize(TELEMETRY_FRAMING, ImuRecord::size));
+    if (data.housekeeping) scheduler.take(wireSize(TELEMETRY_FRAMING, HousekeepingRecord::size));
+    while (data.replays < REPLAY_MAX && backlog >= RAM_BUF_LEN && scheduler.fits(REPLAY_WIRE_MAX)
+           && (data.replays == 0 || backlog >= RAM_BUF_LEN + REPLAY_KEEP_BYTES)){
+        ram.readData(data.ramBuf[data.replays], RAM_BUF_LEN);
+        CodedSweep& coded = data.ramSweepCoded[data.replays];
+        codeSweep(StoredCycle::at<3>(data.ramBuf[data.replays]), coded);
+        size_t stored = coded.length ? StoredCodedSweepRecord::header_size + coded.length : StoredSweepRecord::size;
+        scheduler.replay(wireSize(TELEMETRY_FRAMING, StoredImuRecord::size) + wireSize(TELEMETRY_FRAMING, stored));
+        backlog -= RAM_BUF_LEN;
+        data.replays++;
     }
 }
 
-int shortSize = sizeof(sweepSentinel)+sizeof(sweepTimeStamp)+sizeof(sweep_buffer)+sizeof(imuSentinel)+sizeof(IMUTimeStamp)+sizeof(IMUData);
-
 void sendData(){
     if(!savedSweep){
         return;
     } 
-    if (!sendFromRam && micros() - startTime > RAM_BUFFER_DELAY * 1000000) {
+    if (!sendFromRam && hal::micros() - startTime > RAM_BUFFER_DELAY * 1000000) {
 		sendFromRam = true;
 	}
-    p_memory_block = memory_block;
-    if(sendFromRam && ram.usedBytes()>=RAM_BUF_LEN){
-        // 1. Copy sweepSentinel (3 bytes: e.g., { '#', '#', 'S' }).
-        memcpy(p_memory_block, sweepSentinel, sizeof(sweepSentinel));
-        p_memory_block += sizeof(sweepSentinel);
-
-        // 3. Copy sweep timestamp from ramBuf (4 bytes).
-        memcpy(p_memory_block, p_sweepTimeStamp, sizeof(sweepTimeStamp));
-        p_memory_block += sizeof(sweepTimeStamp);
+    CycleData& data = cycles[cycleSlot];
+    data.sweepTimeStamp = sweepTimeStamp;
+    if (data.housekeeping){
+        // One copy with interrupts off, so TC0_Handler and the PDC cannot change a counter half way through
+        hal::IrqState irq_state = hal::irq_save();
+        for (int i = 0; i < NUM_COUNTERS; i++){
+            data.counters[i] = counters::values[i];
+        }
+        hal::irq_restore(irq_state);
+        data.housekeepingTimeStamp = hal::micros() - startTime;
+    }
+    // Structure: [3-byte sentinel]["4-byte timestamp"]["1-byte payload ID"][sweep data], then the IMU record and, every
+    // HOUSEKEEPING_CYCLES, the ##H record. The replayed records readData() scheduled follow. Layouts are in Telemetry.hpp.
+    // Sweeps that were coded go as ##s/##t.
+    if (TELEMETRY_FRAMING == Framing::COBS){
+        // Same records, encoded into this slot's framed buffer and sent from there
+        uint8_t* out = data.sweepCoded.length
+                     ? CodedSweepRecord::encode(data.framed, data.sweepCoded, data.sweepTimeStamp, shieldID)
+                     : SweepRecord::encode(data.framed, data.sweepTimeStamp, shieldID, data.sweep);
+        out = ImuRecord::encode(out, data.IMUTimeStamp, data.IMUData);
+        if (data.housekeeping){
+            out = HousekeepingRecord::encode(out, data.housekeepingTimeStamp, data.counters);
+        }
+        for (int i = 0; i < data.replays; i++){
+            const uint8_t* stored = data.ramBuf[i];
+            out = StoredImuRecord::encode(out, StoredCycle::at<0>(stored), StoredCycle::at<1>(stored));
+            out = data.ramSweepCoded[i].length
+                ? StoredCodedSweepRecord::encode(out, data.ramSweepCoded[i], StoredCycle::at<2>(stored), shieldID)
+                : StoredSweepRecord::encode(out, StoredCycle::at<2>(stored), shieldID, StoredCycle::at<3>(stored));
+        }
+        pdc.send(data.framed, out - data.framed);
+        return;
+    }
+    TxSegment frame[FRAME_SEGMENTS];
+    uint32_t fecStart = hal::cycle_count();
+    TxSegment* end = addParity(frame, data.sweepCoded.length
+                                      ? CodedSweepRecord::gather(frame, data.sweepCoded, data.sweepTimeStamp, shieldID)
+                                      : SweepRecord::gather(frame, data.sweepTimeStamp, shieldID, data.sweep),
+                               data.parity[0]);
+    end = addParity(end, ImuRecord::gather(end, data.IMUTimeStamp, data.IMUData), data.parity[1]);
+    if (data.housekeeping){
+        end = addParity(end, HousekeepingRecord::gather(end, data.housekeepingTimeStamp, data.counters), data.parity[2]);
+    }
+    for (int i = 0; i < data.replays; i++){
+        const uint8_t* stored = data.ramBuf[i];
+        end = addParity(end, StoredImuRecord::gather(end, StoredCycle::at<0>(stored), StoredCycle::at<1>(stored)),
+                        data.parity[3 + 2 * i]);
+        end = addParity(end, data.ramSweepCoded[i].length
+                             ? StoredCodedSweepRecord::gather(end, data.ramSweepCoded[i], StoredCycle::at<2>(stored), shieldID)
+                             : StoredSweepRecord::gather(end, StoredCycle::at<2>(stored), shieldID, StoredCycle::at<3>(stored)),
+                        data.parity[4 + 2 * i]);
+    }
+    if (TELEMETRY_FRAMING == Framing::REED_SOLOMON){
+        counters::raise(COUNTER_FEC_MAX_CYCLES, hal::cycle_count() - fecStart);
+    }
+    pdc.send_gather(frame, end - frame);
+}
 
-        // 2. Copy payload ID (1 byte) using shieldID.
-        memcpy(p_memory_block, &shieldID, sizeof(shieldID));
-        p_memory_block += sizeof(shieldID);
+/**
+ * @brief Framing::REED_SOLOMON: computes the parity of the record in segments [record, end) into parity and adds a segment
+ * for it after the record. Returns the new end. Does nothing in the other framings.
+ */
+TxSegment* addParity(TxSegment* record, TxSegment* end, uint8_t (&parity)[RS_PARITY]){
+    if (TELEMETRY_FRAMING != Framing::REED_SOLOMON){
+        return end;
+    }
+    RsEncoder block;
+    for (TxSegment* segment = record; segment < end; segment++){
+        block.put(segment->data, segment->length);
+    }
+    block.finish(parity);
+    end->data = parity;
+    end->length = RS_PARITY;
+    return end + 1;
+}
 
-        
-        // 4. Copy sweep ADC data (sweep_buffer).
-        memcpy(p_memory_block, sweep_buffer, sizeof(sweep_buffer));
-        p_memory_block += sizeof(sweep_buffer);
-
-        memcpy(p_memory_block, imuSentinel, sizeof(imuSentinel));
-        p_memory_block += sizeof(imuSentinel);
-        memcpy(p_memory_block, p_IMUTimeStamp, sizeof(IMUTimeStamp));
-        p_memory_block += sizeof(IMUTimeStamp);
-        memcpy(p_memory_block, IMUData, sizeof(IMUData));
-        p_memory_block += sizeof(IMUData);
-        memcpy(p_memory_block, imuSentinelBuf, sizeof(imuSentinelBuf));
-        p_memory_block += sizeof(imuSentinelBuf);
-        memcpy(p_memory_block, ramBuf + IMU_TIMESTAMP_OFFSET, sizeof(IMUTimeStamp));
-        p_memory_block += sizeof(IMUTimeStamp);
-        memcpy(p_memory_block, ramBuf + IMU_DATA_OFFSET, sizeof(IMUData));
-        p_memory_block += sizeof(IMUData);
-        memcpy(p_memory_block, sweepSentinelBuf, sizeof(sweepSentinelBuf));
-        p_memory_block += sizeof(sweepSentinelBuf);
-        memcpy(p_memory_block, ramBuf + SWEEP_TIMESTAMP_OFFSET, sizeof(sweepTimeStamp));
-        p_memory_block += sizeof(sweepTimeStamp);
-        memcpy(p_memory_block, &shieldID, sizeof(shieldID));
-        p_memory_block += sizeof(shieldID);
-        memcpy(p_memory_block, ramBuf + SWEEP_DATA_OFFSET, sizeof(sweep_buffer));
-
-        p_memory_block = memory_block;
-        pdc.send(memory_block, totalSize);
-    } else {
-        // Non-RAM branch:
-        // 1. Copy sweepSentinel (3 bytes).
-        memcpy(p_memory_block, sweepSentinel, sizeof(sweepSentinel));
-        p_memory_block += sizeof(sweepSentinel);
-        // 3. Copy sweep timestamp from p_sweepTimeStamp (4 bytes).
-        memcpy(p_memory_block, p_sweepTimeStamp, sizeof(sweepTimeStamp));
-        p_memory_block += sizeof(sweepTimeStamp);
-        // 2. Copy payload ID (1 byte) as shieldID.
-        memcpy(p_memory_block, &shieldID, sizeof(shieldID));
-        p_memory_block += sizeof(shieldID);
-
-     
-
-
-        // 4. Copy sweep ADC data.
-        memcpy(p_memory_block, sweep_buffer, sizeof(sweep_buffer));
-        p_memory_block += sizeof(sweep_buffer);
-
-        memcpy(p_memory_block, imuSentinel, sizeof(imuSentinel));
-        p_memory_block += sizeof(imuSentinel);
-        memcpy(p_memory_block, p_IMUTimeStamp, sizeof(IMUTimeStamp));
-        p_memory_block += sizeof(IMUTimeStamp);
-        memcpy(p_memory_block, IMUData, sizeof(IMUData));
-        
-        // Structure: [3-byte sentinel]["4-byte timestamp"]["1-byte payload ID"][sweep data]...
-        p_memory_block += sizeof(IMUData);
-        pdc.send(memory_block, shortSize);
-    } 
-    
+/**
+ * @brief SweepCoding::RICE: codes sweep into coded, in the cycle's slack after the sweep (or the EEPROM read) rather than
+ * in sendData(). Leaves coded empty, so the sweep goes raw, with SweepCoding::RAW or if it does not code shorter.
+ */
+void codeSweep(const uint16_t (&sweep)[SweepController::SWEEP_SAMPLES], CodedSweep& coded){
+    if (SWEEP_CODING != SweepCoding::RICE){
+        coded.length = 0;
+        return;
+    }
+    uint32_t start = hal::cycle_count();
+    coded.length = (uint16_t)sweepEncode(sweep, SWEEP_STEPS, SWEEP_PROBES, coded.bytes, CodedSweep::max);
+    counters::raise(COUNTER_CODING_MAX_CYCLES, hal::cycle_count() - start);
 }
 
 /* void sendSweepData(){
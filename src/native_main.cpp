@@ -0,0 +1,325 @@
+/**
+ * @file native_main.cpp
+ * @brief Entry point for the host build (native environment in platformio.ini).
+ *
+ * Links the real main.cpp and drivers against the simulated shield in HALSim.cpp. Run
+ *
+ *     pio run -e native && .pio/build/native/program bench [iterations]
+ *
+ * to time PipController::sweep, AT25M02::writeData, sweepEncode, RsEncoder and the main.cpp frame packing (sendData). Wall
+ * time is what the code costs on this machine, virtual time is what the HAL calls would cost on the Due. Computation is
+ * free in virtual time, so the RsEncoder line is all wall time (and TSC cycles on x86), and the fec_max_cycles and
+ * coding_max_cycles counters stay 0 in the simulator: they only measure something on the Due.
+ *
+ *     .pio/build/native/program flight [options]
+ *
+ * simulates a whole flight, see ShieldSim.hpp.
+ *
+ *     .pio/build/native/program spi-compare
+ *
+ * runs one sweep with each AdcTransport, Acquisition and Conversion mode from the same ADC noise seed, checks that
+ * the Max1148 sees the same byte stream polled and with DMA, chip select framing included, and that every mode produces
+ * the same data. Prints the MCK cycles (hal::cycle_count) each sweep takes. Last, checks that a timer stepped sweep
+ * (DacStepping::TIMER) gives the same data as a CPU stepped one.
+ *
+ *     .pio/build/native/program decode FILE [--cobs | --fec] [--csv PREFIX]
+ *
+ * decodes a UART capture (flight --capture) or a serial port with TelemetryDecoder, optionally to PREFIXS.csv etc.
+ * --cobs or --fec for a shield built with TELEMETRY_FRAMING Framing::COBS or Framing::REED_SOLOMON.
+ *
+ * Left out of pio test builds, where each suite under test/ brings its own main.
+ */
+#if !defined(ARDUINO) && !defined(PIO_UNIT_TESTING)
+#include <HALSim.hpp>
+#include <ShieldSim.hpp>
+#include <SweepConfig.hpp>
+#include <AT25M02.hpp>
+#include <Telemetry.hpp>
+#include <TelemetryDecoder.hpp>
+#include <ReedSolomon.hpp>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Length of one stored cycle, RAM_BUF_LEN in main.cpp
+#define BENCH_RECORD_LEN StoredCycle::size
+// A frame with one replay, ##S ##I ##T ##J: 294 bytes as shipped
+#define BENCH_FEC_FRAME_LEN (SweepRecord::size + ImuRecord::size + StoredSweepRecord::size + StoredImuRecord::size)
+// SAMPLE_PERIOD in sweep_values_v5_1.h, in ns. Lets the UART drain between frames.
+#define BENCH_CYCLE_NS 22222000ULL
+// Any fixed seed works, both sweeps just need the same one
+#define COMPARE_ADC_SEED 12345u
+// SWEEP_STEP_PERIOD in main.cpp
+#define COMPARE_STEP_PERIOD_US 401
+
+//========== From main.cpp ==========//
+void setup();
+void sendData();
+extern SweepController pipController;
+extern AT25M02 ram;
+extern bool savedSweep;
+extern SweepPip pip0;
+extern SweepPip pip1;
+extern Max1148 adc0;
+extern Max1148 adc1;
+
+namespace {
+    typedef void (*BenchFn)();
+
+    uint16_t benchSamples[SweepController::SWEEP_SAMPLES];
+    uint8_t benchRecord[BENCH_RECORD_LEN];
+
+    void benchSweep(){
+        pipController.sweep(benchSamples);
+    }
+
+    void benchStore(){
+        ram.writeData(benchRecord, BENCH_RECORD_LEN);
+    }
+
+    uint8_t benchCoded[SWEEP_CODED_MAX];
+
+    void benchEncode(){
+        sweepEncode(benchSamples, SWEEP_STEPS, SWEEP_PROBES, benchCoded, SWEEP_CODED_MAX);
+    }
+
+    uint8_t benchFrame[BENCH_FEC_FRAME_LEN];
+    uint8_t benchParity[4][RS_PARITY];
+
+    /*
+     * Parity for each record of a frame, like addParity() in main.cpp with Framing::REED_SOLOMON.
+     */
+    void benchFec(){
+        const size_t records[4] = { SweepRecord::size, ImuRecord::size, StoredSweepRecord::size, StoredImuRecord::size };
+        const uint8_t* record = benchFrame;
+        for (int r = 0; r < 4; r++){
+            RsEncoder block;
+            block.put(record, records[r]);
+            block.finish(benchParity[r]);
+            record += records[r];
+        }
+        // Nothing reads the parity, keep the compiler from dropping or hoisting the encode
+        __asm__ __volatile__("" : : "r"(benchParity) : "memory");
+    }
+
+    void benchSend(){
+        savedSweep = true;
+        sendData();
+    }
+
+    /*
+     * Runs fn the given number of times. Prints mean wall and virtual time per call.
+     */
+    void run(const char* name, BenchFn fn, int iterations, bool drain){
+        double wall_ns = 0;
+        uint64_t virtual_ns = 0;
+        for (int i = 0; i < iterations; i++){
+            uint64_t v0 = hal::sim::now_ns();
+            std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+            fn();
+            std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+            virtual_ns += hal::sim::now_ns() - v0;
+            wall_ns += std::chrono::duration<double, std::nano>(t1 - t0).count();
+            if (drain) hal::sim::advance_ns(BENCH_CYCLE_NS);
+        }
+        printf("%-22s %8d calls  %12.1f ns wall/call  %12.1f us virtual/call\n", name, iterations,
+               wall_ns / iterations, (double)virtual_ns / iterations / 1000.0);
+    }
+
+    int bench(int iterations){
+        setup();
+        memset(benchRecord, 0xA5, BENCH_RECORD_LEN);
+        run("PipController::sweep", benchSweep, iterations, false);
+        run("AT25M02::writeData", benchStore, iterations, false);
+        run("sweepEncode", benchEncode, iterations, false);
+        printf("sweepEncode: %zu bytes for a %zu byte sweep\n",
+               sweepEncode(benchSamples, SWEEP_STEPS, SWEEP_PROBES, benchCoded, SWEEP_CODED_MAX), (size_t)SweepField::size);
+        for (size_t i = 0; i < BENCH_FEC_FRAME_LEN; i++) benchFrame[i] = (uint8_t)(i * 31 + 7);
+        run("RsEncoder (frame)", benchFec, iterations, false);
+#if defined(__x86_64__) || defined(__i386__)
+        uint64_t tsc0 = __rdtsc();
+        for (int i = 0; i < iterations; i++) benchFec();
+        uint64_t tsc1 = __rdtsc();
+        printf("RsEncoder: %.0f TSC cycles per %zu byte frame on this machine\n", (double)(tsc1 - tsc0) / iterations,
+               (size_t)BENCH_FEC_FRAME_LEN);
+#endif
+        printf("fec_max_cycles and coding_max_cycles only mean something on the Due: the simulator charges nothing "
+               "for computation\n");
+        run("sendData", benchSend, iterations, true);
+        printf("UART bytes sent: %llu, ADC conversions: %llu, EEPROM pages written: %llu\n",
+               (unsigned long long)hal::sim::uart_bytes_sent(),
+               (unsigned long long)hal::sim::adc().conversions,
+               (unsigned long long)hal::sim::eeprom().page_writes);
+        return 0;
+    }
+
+    struct SweepRun {
+        std::vector<hal::sim::SpiTraceEntry> trace;
+        std::vector<uint16_t> data;
+        uint32_t cycles;
+    };
+
+    void setTransport(AdcTransport transport){
+        adc0.set_transport(transport);
+        adc1.set_transport(transport);
+    }
+
+    SweepRun traceSweep(Acquisition mode, Conversion conversion){
+        SweepRun run;
+        pipController.set_acquisition(mode, conversion);
+        hal::sim::adc().seed(COMPARE_ADC_SEED);
+        hal::sim::spi_trace_enable(true);
+        uint32_t c0 = hal::cycle_count();
+        uint16_t data[SweepController::SWEEP_SAMPLES];
+        pipController.sweep(data);
+        run.cycles = hal::cycle_count() - c0;
+        hal::sim::spi_trace_enable(false);
+        run.trace = hal::sim::spi_trace();
+        run.data.assign(data, data + SweepController::SWEEP_SAMPLES);
+        return run;
+    }
+
+    /*
+     * Compares the bus traffic of a polled and a DMA sweep byte by byte. Returns the number of differences reported.
+     */
+    int compareTraces(const char* name, const SweepRun& polled, const SweepRun& dma){
+        int failures = 0;
+        if (polled.trace.size() != dma.trace.size()){
+            printf("%s: byte count differs: polled %zu, dma %zu\n", name, polled.trace.size(), dma.trace.size());
+            failures++;
+        }
+        size_t n = polled.trace.size() < dma.trace.size() ? polled.trace.size() : dma.trace.size();
+        for (size_t i = 0; i < n && failures < 10; i++){
+            const hal::sim::SpiTraceEntry& a = polled.trace[i];
+            const hal::sim::SpiTraceEntry& b = dma.trace[i];
+            if (a.cs_pin != b.cs_pin || a.mosi != b.mosi || a.miso != b.miso || a.frame_start != b.frame_start){
+                printf("%s: byte %zu differs: polled cs %u mosi %02X miso %02X%s, dma cs %u mosi %02X miso %02X%s\n",
+                       name, i, a.cs_pin, a.mosi, a.miso, a.frame_start ? " start" : "",
+                       b.cs_pin, b.mosi, b.miso, b.frame_start ? " start" : "");
+                failures++;
+            }
+        }
+        printf("%-20s %6zu SPI bytes per sweep, polled %8u cycles, dma %8u cycles: %s\n", name,
+               polled.trace.size(), (unsigned)polled.cycles, (unsigned)dma.cycles,
+               failures ? "MISMATCH" : "same bytes");
+        return failures;
+    }
+
+    int spiCompare(){
+        setup();
+        hal::cycle_counter_begin();
+        // Byte streams are compared with the CPU stepping the DACs - single conversions do not fit the timer's step period
+        pipController.set_dac_stepping(DacStepping::CPU);
+        const AdcTransport transports[] = { AdcTransport::GPIO_CS, AdcTransport::HW_CS16 };
+        const char* transportNames[] = { "gpio-cs", "hw-cs16" };
+        const Conversion conversions[] = { Conversion::SINGLE, Conversion::PIPELINED };
+        const char* conversionNames[] = { "single", "pipelined" };
+
+        int failures = 0;
+        std::vector<uint16_t> reference;
+        for (int t = 0; t < 2; t++){
+            setTransport(transports[t]);
+            for (int c = 0; c < 2; c++){
+                SweepRun polled = traceSweep(Acquisition::POLLED, conversions[c]);
+                SweepRun dma = traceSweep(Acquisition::DMA, conversions[c]);
+                char name[32];
+                snprintf(name, sizeof(name), "%s %s", transportNames[t], conversionNames[c]);
+                failures += compareTraces(name, polled, dma);
+                // Every mode samples the same channels in the same order, so the data must not change
+                if (reference.empty()) reference = polled.data;
+                if (polled.data != reference || dma.data != reference){
+                    printf("%s: sweep data differs from gpio-cs single\n", name);
+                    failures++;
+                }
+            }
+            pipController.set_acquisition(Acquisition::POLLED);
+        }
+
+        // Timer stepped DACs must give the same codes and so the same data, with no step running late
+        SweepRun cpuStepped = traceSweep(Acquisition::DMA, Conversion::PIPELINED);
+        pipController.set_dac_stepping(DacStepping::TIMER, COMPARE_STEP_PERIOD_US);
+        uint32_t late = pipController.get_late_steps();
+        SweepRun timerStepped = traceSweep(Acquisition::DMA, Conversion::PIPELINED);
+        late = pipController.get_late_steps() - late;
+        bool same = timerStepped.data == cpuStepped.data && late == 0;
+        printf("%-20s %6zu SPI bytes per sweep, cpu    %8u cycles, timer %7u cycles: %s, %u late steps\n",
+               "hw-cs16 dac timer", timerStepped.trace.size(), (unsigned)cpuStepped.cycles,
+               (unsigned)timerStepped.cycles, same ? "same data" : "MISMATCH", (unsigned)late);
+        if (!same) failures++;
+        pipController.set_dac_stepping(DacStepping::CPU);
+
+        setTransport(AdcTransport::GPIO_CS);
+        printf("%s\n", failures ? "MISMATCH" : "all modes produce identical sweep data");
+        return failures ? 1 : 0;
+    }
+
+    /*
+     * Decodes a capture file or serial port. Prints what was in it and how fast it decoded, and writes CSVs if asked to.
+     */
+    int decode(int argc, char** argv){
+        const char* path = NULL;
+        const char* csv = NULL;
+        Framing framing = Framing::SENTINEL;
+        for (int i = 0; i < argc; i++){
+            if (strcmp(argv[i], "--csv") == 0 && i + 1 < argc) csv = argv[++i];
+            else if (strcmp(argv[i], "--cobs") == 0) framing = Framing::COBS;
+            else if (strcmp(argv[i], "--fec") == 0) framing = Framing::REED_SOLOMON;
+            else path = argv[i];
+        }
+        if (!path){
+            fprintf(stderr, "decode: no input\n");
+            return 2;
+        }
+        TelemetryDecoder decoder(framing);
+        std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+        if (!decodeFile(path, decoder)){
+            perror(path);
+            return 1;
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        const DecodedTelemetry& t = decoder.result();
+        printf("%llu bytes in %.3f s (%.0f MB/s)\n", (unsigned long long)t.bytes, seconds, t.bytes / seconds / 1e6);
+        printf("##S %zu  ##I %zu  ##T %zu  ##J %zu  ##H %zu records, %llu sweeps coded\n", t.sweeps.size(), t.imu.size(),
+               t.stored_sweeps.size(), t.stored_imu.size(), t.housekeeping.size(), (unsigned long long)t.coded);
+        if (framing == Framing::REED_SOLOMON){
+            printf("%llu bytes skipped, %llu bytes corrected, %llu blocks beyond repair\n", (unsigned long long)t.skipped,
+                   (unsigned long long)t.corrected, (unsigned long long)t.rejected);
+        } else if (framing == Framing::COBS){
+            printf("%llu bytes skipped, %llu packets rejected\n", (unsigned long long)t.skipped,
+                   (unsigned long long)t.rejected);
+        } else {
+            printf("%llu bytes skipped, sync lost %llu times\n", (unsigned long long)t.skipped,
+                   (unsigned long long)t.resyncs);
+        }
+        if (csv && !writeCsv(t, csv)){
+            perror(csv);
+            return 1;
+        }
+        return 0;
+    }
+}
+
+int main(int argc, char** argv){
+    if (argc >= 2 && strcmp(argv[1], "bench") == 0){
+        return bench(argc >= 3 ? atoi(argv[2]) : 1000);
+    }
+    if (argc >= 2 && strcmp(argv[1], "flight") == 0){
+        return runFlight(argc - 2, argv + 2);
+    }
+    if (argc >= 2 && strcmp(argv[1], "spi-compare") == 0){
+        return spiCompare();
+    }
+    if (argc >= 2 && strcmp(argv[1], "decode") == 0){
+        return decode(argc - 2, argv + 2);
+    }
+    fprintf(stderr, "usage: %s bench [iterations]\n"
+                    "       %s flight [--seconds N] [--period US] [--sync-off A:B] [--capture FILE]\n"
+                    "       %s spi-compare\n"
+                    "       %s decode FILE [--cobs | --fec] [--csv PREFIX]\n", argv[0], argv[0], argv[0], argv[0]);
+    return 2;
+}
+#endif
@@ -0,0 +1,173 @@
+/**
+ * @file test_main.cpp
+ * @brief Host tests for the ground side TelemetryDecoder.
+ *
+ *     pio test -e native -f test_decoder
+ */
+#include <unity.h>
+#include <TelemetryDecoder.hpp>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+// Random buffers each sentinel search is checked on
+#ifndef DECODER_TEST_BUFFERS
+#define DECODER_TEST_BUFFERS 20000
+#endif
+#ifndef DECODER_TEST_SEED
+#define DECODER_TEST_SEED 12345u
+#endif
+
+namespace {
+    uint32_t rng;
+
+    uint32_t rnd(){
+        rng ^= rng << 13;
+        rng ^= rng >> 17;
+        rng ^= rng << 5;
+        return rng;
+    }
+
+    /**
+     * @brief Feeds stream to decoder in random sized chunks, so records are cut off between calls, then finishes.
+     */
+    void feedInChunks(TelemetryDecoder& decoder, const std::vector<uint8_t>& stream){
+        size_t pos = 0;
+        while (pos < stream.size()){
+            size_t n = 1 + rnd() % 700;
+            if (n > stream.size() - pos) n = stream.size() - pos;
+            decoder.feed(&stream[pos], n);
+            pos += n;
+        }
+        decoder.finish();
+    }
+
+    typedef const uint8_t* (*Search)(const uint8_t*, const uint8_t*);
+
+    /**
+     * @brief Runs search and the scalar search over buffers of '#', record IDs and other bytes, at every alignment and
+     * length up to 200 bytes, and fails at the first place they disagree.
+     */
+    void matchesScalar(Search search, const char* name){
+        static const uint8_t alphabet[] = { '#', '#', '#', '#', SweepRecord::id, StoredSweepRecord::id, ImuRecord::id,
+                                            StoredImuRecord::id, CodedSweepRecord::id, StoredCodedSweepRecord::id,
+                                            HousekeepingRecord::id, 'A', 0, 0xFF, '$', '"' };
+        static uint8_t buf[256];
+        char msg[128];
+        rng = DECODER_TEST_SEED;
+        for (int b = 0; b < DECODER_TEST_BUFFERS; b++){
+            // Mostly noise with the odd sentinel, sometimes dense with '#', so a hit can be anywhere in a vector
+            bool dense = rnd() % 4 == 0;
+            for (size_t i = 0; i < sizeof(buf); i++){
+                buf[i] = dense ? alphabet[rnd() % sizeof(alphabet)] : (uint8_t)rnd();
+            }
+            if (!dense) memcpy(buf + rnd() % (sizeof(buf) - 2), "##", 2);
+            size_t begin = rnd() % 48;
+            size_t length = rnd() % 200;
+            // A sentinel cut off by the end
+            if (b % 3 == 0 && length >= 2) buf[begin + length - 1 - rnd() % 2] = '#';
+            const uint8_t* want = sentinel_search::scalar(buf + begin, buf + begin + length);
+            const uint8_t* got = search(buf + begin, buf + begin + length);
+            if (got != want){
+                snprintf(msg, sizeof(msg), "%s: buffer %d, [%u, %u): found %d, scalar %d", name, b, (unsigned)begin,
+                         (unsigned)(begin + length), (int)(got - buf), (int)(want - buf));
+                TEST_FAIL_MESSAGE(msg);
+            }
+        }
+    }
+}
+
+void setUp(){}
+void tearDown(){}
+
+/*
+ * A Framing::COBS stream of ##S and ##I records, with one record in eight damaged: a byte changed (never to or from the
+ * delimiter), a byte dropped, or the delimiter dropped, which runs the record into the next one. Every damaged packet
+ * has to be rejected and nothing else: each record that was left alone decodes, in order and intact, so the decoder
+ * picks up again at the delimiter after each damaged one.
+ */
+void test_cobs_rejects_damaged_records_and_resyncs(){
+    const int records = 4000;
+    rng = DECODER_TEST_SEED;
+    std::vector<uint8_t> stream;
+    std::vector<uint32_t> sweep_stamps;
+    std::vector<uint16_t> sweep_samples;
+    std::vector<uint32_t> imu_stamps;
+    uint64_t damaged_packets = 0;
+    uint8_t packet[SweepRecord::framed_size];
+    bool run_into = false;  // the last record lost its delimiter
+    for (int r = 0; r < records; r++){
+        uint32_t stamp = 1000 + r;
+        uint16_t samples[SweepField::count];
+        int16_t imu[ImuField::count];
+        uint8_t* end;
+        // Plenty of zero bytes, so the COBS runs are short and varied
+        for (size_t i = 0; i < SweepField::count; i++) samples[i] = (uint16_t)(rnd() % 3 ? rnd() & 0x3FFF : 0);
+        for (size_t i = 0; i < ImuField::count; i++) imu[i] = (int16_t)(rnd() % 3 ? rnd() : 0);
+        if (r % 2 == 0) end = SweepRecord::encode(packet, stamp, (uint8_t)60, samples);
+        else end = ImuRecord::encode(packet, stamp, imu);
+        size_t length = end - packet;
+
+        int damage = run_into ? 0 : rnd() % 8 == 0 ? 1 + rnd() % 3 : 0;
+        if (damage == 1){
+            size_t at = rnd() % (length - 1);
+            uint8_t flip = (uint8_t)(1 + rnd() % 255);
+            if ((packet[at] ^ flip) == 0) flip ^= 1;
+            packet[at] ^= flip;
+        } else if (damage == 2){
+            size_t at = rnd() % (length - 1);
+            memmove(packet + at, packet + at + 1, length - at - 1);
+            length--;
+        } else if (damage == 3 && r + 1 < records){
+            length--;
+        } else {
+            damage = 0;
+        }
+        if (damage) damaged_packets++;
+        if (!damage && !run_into){
+            if (r % 2 == 0){
+                sweep_stamps.push_back(stamp);
+                sweep_samples.insert(sweep_samples.end(), samples, samples + SweepField::count);
+            } else {
+                imu_stamps.push_back(stamp);
+            }
+        }
+        run_into = damage == 3;
+        stream.insert(stream.end(), packet, packet + length);
+    }
+
+    TelemetryDecoder decoder(Framing::COBS);
+    feedInChunks(decoder, stream);
+    const DecodedTelemetry& out = decoder.result();
+    char msg[96];
+    snprintf(msg, sizeof(msg), "%u records, %u damaged", (unsigned)records, (unsigned)damaged_packets);
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_GREATER_THAN(records / 16, damaged_packets);
+    TEST_ASSERT_EQUAL_UINT64(damaged_packets, out.rejected);
+    TEST_ASSERT_EQUAL_UINT32(sweep_stamps.size(), out.sweeps.size());
+    TEST_ASSERT_EQUAL_UINT32(imu_stamps.size(), out.imu.size());
+    TEST_ASSERT_EQUAL_UINT32_ARRAY(&sweep_stamps[0], &out.sweeps.time_stamp[0], sweep_stamps.size());
+    TEST_ASSERT_EQUAL_UINT16_ARRAY(&sweep_samples[0], &out.sweeps.samples[0], sweep_samples.size());
+    TEST_ASSERT_EQUAL_UINT32_ARRAY(&imu_stamps[0], &out.imu.time_stamp[0], imu_stamps.size());
+}
+
+#if defined(__SSE2__)
+void test_sse2_sentinel_search_matches_scalar(){
+    matchesScalar(sentinel_search::sse2, "sse2");
+}
+
+void test_avx2_sentinel_search_matches_scalar(){
+    if (!sentinel_search::avx2_supported()) TEST_IGNORE_MESSAGE("no AVX2 on this CPU");
+    matchesScalar(sentinel_search::avx2, "avx2");
+}
+#endif
+
+int main(int argc, char** argv){
+    UNITY_BEGIN();
+    RUN_TEST(test_cobs_rejects_damaged_records_and_resyncs);
+#if defined(__SSE2__)
+    RUN_TEST(test_sse2_sentinel_search_matches_scalar);
+    RUN_TEST(test_avx2_sentinel_search_matches_scalar);
+#endif
+    return UNITY_END();
+}
@@ -0,0 +1,466 @@
+/**
+ * @file test_main.cpp
+ * @brief Host tests for the AT25M02 driver, run against the AT25M02 model in HALSim.cpp.
+ *
+ *     pio test -e native -f test_eeprom
+ *
+ * The driver is main.cpp's ram, so DMA transfers finish through main.cpp's DMAC_Handler like they do on the board.
+ * Every test starts from init(): an empty queue at address 0 and an erased chip. The HW_CS_DMA tests need AT25M02_DMA,
+ * which the native environment sets.
+ */
+#include <unity.h>
+#include <HALSim.hpp>
+#include <AT25M02.hpp>
+#include <Counters.hpp>
+#include <algorithm>
+#include <deque>
+#include <vector>
+#include <stdio.h>
+#include <string.h>
+
+// Operations in each run of the property test (one run per transport), and where its random sequence starts. Rebuild
+// with -DEEPROM_TEST_OPS=... or -DEEPROM_TEST_SEED=... to run it longer or down another path. A million takes about 40 s.
+#ifndef EEPROM_TEST_OPS
+#define EEPROM_TEST_OPS 1000000
+#endif
+#ifndef EEPROM_TEST_SEED
+#define EEPROM_TEST_SEED 12345u
+#endif
+
+#define TEST_RAM_SIZE (1UL << 18)
+#define TEST_PAGE_LEN 256
+// CHIP_SELECT_PIN in AT25M02.cpp
+#define TEST_EEPROM_CS 4
+// One stored cycle, StoredCycle::size in Telemetry.hpp
+#define TEST_RECORD_LEN 140
+// SAMPLE_PERIOD in sweep_values_v5_1.h
+#define TEST_CYCLE_NS 22222000ULL
+
+//========== From main.cpp ==========//
+extern AT25M02 ram;
+
+namespace {
+    uint32_t rng;
+
+    uint32_t rnd(){
+        rng ^= rng << 13;
+        rng ^= rng >> 17;
+        rng ^= rng << 5;
+        return rng;
+    }
+
+    /**
+     * @brief Lets any write cycle or transfer left by the last test finish, erases the chip and starts the driver on
+     * the given transport. Returns once the status register write in init() is done too, so the chip is idle.
+     */
+    void begin(EepromTransport transport){
+        hal::sim::advance_ns(2 * SIM_EEPROM_WRITE_CYCLE_NS);
+        hal::sim::AT25M02Model& chip = hal::sim::eeprom();
+        std::fill(chip.memory.begin(), chip.memory.end(), 0xFF);
+        ram.init();
+        ram.set_transport(transport);
+        hal::sim::advance_ns(2 * SIM_EEPROM_WRITE_CYCLE_NS);
+    }
+
+    /**
+     * @brief Model counters that mean the driver misused the chip. All of them must stay where they were.
+     */
+    struct ChipFaults {
+        uint64_t rejected_while_busy;
+        uint64_t writes_without_wel;
+        uint64_t reads_wrapped;
+        uint64_t page_rollovers;
+
+        ChipFaults(){
+            hal::sim::AT25M02Model& chip = hal::sim::eeprom();
+            rejected_while_busy = chip.rejected_while_busy;
+            writes_without_wel = chip.writes_without_wel;
+            reads_wrapped = chip.reads_wrapped;
+            page_rollovers = chip.page_rollovers;
+        }
+        void check() const {
+            hal::sim::AT25M02Model& chip = hal::sim::eeprom();
+            TEST_ASSERT_EQUAL_UINT64(rejected_while_busy, chip.rejected_while_busy);
+            TEST_ASSERT_EQUAL_UINT64(writes_without_wel, chip.writes_without_wel);
+            TEST_ASSERT_EQUAL_UINT64(reads_wrapped, chip.reads_wrapped);
+            TEST_ASSERT_EQUAL_UINT64(page_rollovers, chip.page_rollovers);
+        }
+    };
+
+    /**
+     * @brief Commands with the given opcode the chip received since spi_trace_enable(true), one per chip select.
+     */
+    std::vector<std::vector<uint8_t> > commands(uint8_t opcode){
+        std::vector<std::vector<uint8_t> > found;
+        bool in_command = false;
+        for (const hal::sim::SpiTraceEntry& e : hal::sim::spi_trace()){
+            if (e.cs_pin != TEST_EEPROM_CS) continue;
+            if (e.frame_start){
+                in_command = e.mosi == opcode;
+                if (in_command) found.push_back(std::vector<uint8_t>());
+            }
+            if (in_command) found.back().push_back(e.mosi);
+        }
+        return found;
+    }
+
+    /**
+     * @brief Writes a counting stream as stored cycles, the first two pages back to back and the rest a sample period
+     * apart like the flight, then checks the chip was sent every full page, in order, at consecutive addresses, and that
+     * no writeData() sat out a write cycle.
+     */
+    void pageOrder(EepromTransport transport){
+        begin(transport);
+        ChipFaults faults;
+        hal::sim::spi_trace_enable(true);
+        const uint32_t pages = 12;
+        static uint8_t stream[pages * TEST_PAGE_LEN + TEST_RECORD_LEN];
+        for (uint32_t i = 0; i < sizeof(stream); i++) stream[i] = (uint8_t)(i * 7 + i / 256);
+
+        // Two pages with no time between writes: the first is programmed, the second has to wait for its write cycle
+        uint32_t written = 0;
+        uint64_t start = hal::sim::now_ns();
+        while (written < 2 * TEST_PAGE_LEN){
+            TEST_ASSERT_TRUE(ram.writeData(stream + written, TEST_RECORD_LEN));
+            written += TEST_RECORD_LEN;
+        }
+        TEST_ASSERT_LESS_THAN_UINT64(SIM_EEPROM_WRITE_CYCLE_NS, hal::sim::now_ns() - start);
+        // Past the first page's transfer but not its write cycle
+        hal::sim::advance_ns(SIM_EEPROM_WRITE_CYCLE_NS / 5);
+        TEST_ASSERT_TRUE(hal::sim::eeprom().busy());
+        start = hal::sim::now_ns();
+        TEST_ASSERT_TRUE_MESSAGE(ram.poll(), "the second page should still be waiting");
+        TEST_ASSERT_LESS_THAN_UINT64(SIM_EEPROM_WRITE_CYCLE_NS / 5, hal::sim::now_ns() - start);
+        TEST_ASSERT_EQUAL_UINT32(1, commands(WRITE_PAGE).size());
+
+        while (written + TEST_RECORD_LEN <= sizeof(stream)){
+            hal::sim::advance_ns(TEST_CYCLE_NS / 2);
+            ram.poll();
+            hal::sim::advance_ns(TEST_CYCLE_NS / 2);
+            uint64_t before = hal::sim::now_ns();
+            TEST_ASSERT_TRUE(ram.writeData(stream + written, TEST_RECORD_LEN));
+            TEST_ASSERT_LESS_THAN_UINT64(SIM_EEPROM_WRITE_CYCLE_NS / 2, hal::sim::now_ns() - before);
+            written += TEST_RECORD_LEN;
+        }
+        while (ram.poll() || hal::sim::eeprom().busy()) hal::sim::advance_ns(SIM_EEPROM_WRITE_CYCLE_NS / 4);
+        hal::sim::spi_trace_enable(false);
+        faults.check();
+
+        std::vector<std::vector<uint8_t> > programs = commands(WRITE_PAGE);
+        TEST_ASSERT_EQUAL_UINT32(written / TEST_PAGE_LEN, programs.size());
+        for (uint32_t p = 0; p < programs.size(); p++){
+            const std::vector<uint8_t>& command = programs[p];
+            TEST_ASSERT_EQUAL_UINT32(4 + TEST_PAGE_LEN, command.size());
+            uint32_t address = ((uint32_t)command[1] << 16) | ((uint32_t)command[2] << 8) | command[3];
+            TEST_ASSERT_EQUAL_UINT32(p * TEST_PAGE_LEN, address);
+            TEST_ASSERT_EQUAL_UINT8_ARRAY(stream + p * TEST_PAGE_LEN, &command[4], TEST_PAGE_LEN);
+        }
+        TEST_ASSERT_EQUAL_UINT8_ARRAY(stream, &hal::sim::eeprom().memory[0], programs.size() * TEST_PAGE_LEN);
+    }
+
+    /**
+     * @brief Stores a few pages of cycles, gives poll() idle time to read ahead, then checks a replay's reads are served
+     * from SRAM: no READ on the bus and no virtual time spent, and the bytes are right. Once they are consumed, poll()
+     * reads the next pages ahead.
+     */
+    void readAhead(EepromTransport transport){
+        begin(transport);
+        ChipFaults faults;
+        const uint32_t records = 16;
+        static uint8_t stream[records * TEST_RECORD_LEN];
+        for (uint32_t i = 0; i < sizeof(stream); i++) stream[i] = (uint8_t)(i * 13 + i / 256);
+        for (uint32_t r = 0; r < records; r++){
+            TEST_ASSERT_TRUE(ram.writeData(stream + r * TEST_RECORD_LEN, TEST_RECORD_LEN));
+            hal::sim::advance_ns(TEST_CYCLE_NS);
+            ram.poll();
+        }
+        for (int i = 0; i < 16; i++){
+            hal::sim::advance_ns(SIM_EEPROM_WRITE_CYCLE_NS);
+            ram.poll();
+        }
+
+        hal::sim::spi_trace_enable(true);
+        static uint8_t replay[4 * TEST_RECORD_LEN];
+        uint64_t start = hal::sim::now_ns();
+        TEST_ASSERT_EQUAL_INT(sizeof(replay), ram.readData(replay, sizeof(replay)));
+        TEST_ASSERT_LESS_THAN_UINT64(1000, hal::sim::now_ns() - start);
+        TEST_ASSERT_EQUAL_UINT32(0, commands(READ).size());
+        TEST_ASSERT_EQUAL_UINT8_ARRAY(stream, replay, sizeof(replay));
+
+        // Refilled in the background, then the next replay is served from SRAM again
+        for (int i = 0; i < 8; i++){
+            hal::sim::advance_ns(SIM_EEPROM_WRITE_CYCLE_NS);
+            ram.poll();
+        }
+        TEST_ASSERT_GREATER_THAN(0, commands(READ).size());
+        hal::sim::spi_trace_enable(true);
+        TEST_ASSERT_EQUAL_INT(sizeof(replay), ram.readData(replay, sizeof(replay)));
+        TEST_ASSERT_EQUAL_UINT32(0, commands(READ).size());
+        TEST_ASSERT_EQUAL_UINT8_ARRAY(stream + sizeof(replay), replay, sizeof(replay));
+        hal::sim::spi_trace_enable(false);
+        faults.check();
+    }
+
+    /**
+     * @brief Fills the queue to 100 bytes short of full, then checks a vectored write that does not fit leaves the
+     * queue exactly as it was, even though its first segment would fit, and that one that fits exactly goes in whole.
+     */
+    void vectoredNearFull(EepromTransport transport){
+        begin(transport);
+        ChipFaults faults;
+        std::deque<uint8_t> ref;
+        static uint8_t buf[1000];
+        uint8_t next = 0;
+        while (ram.freeBytes() > 100){
+            uint32_t n = ram.freeBytes() - 100 < sizeof(buf) ? ram.freeBytes() - 100 : sizeof(buf);
+            for (uint32_t i = 0; i < n; i++) buf[i] = next++;
+            TEST_ASSERT_TRUE(ram.writeData(buf, n));
+            ref.insert(ref.end(), buf, buf + n);
+            hal::sim::advance_ns(SIM_EEPROM_WRITE_CYCLE_NS);
+            ram.poll();
+        }
+        TEST_ASSERT_EQUAL_UINT32(100, ram.freeBytes());
+
+        static uint8_t head[60];
+        static uint8_t tail[60];
+        memset(head, 0xA5, sizeof(head));
+        memset(tail, 0x5A, sizeof(tail));
+        TxSegment too_long[2] = { { head, 60 }, { tail, 60 } };
+        uint32_t used = ram.usedBytes();
+        uint32_t rejected = counters::get(COUNTER_EEPROM_REJECTED);
+        uint32_t written = counters::get(COUNTER_EEPROM_WRITTEN);
+        TEST_ASSERT_FALSE(ram.writeData(too_long, 2));
+        TEST_ASSERT_EQUAL_UINT32(used, ram.usedBytes());
+        TEST_ASSERT_EQUAL_UINT32(rejected + 1, counters::get(COUNTER_EEPROM_REJECTED));
+        TEST_ASSERT_EQUAL_UINT32(written, counters::get(COUNTER_EEPROM_WRITTEN));
+
+        TxSegment exact[2] = { { head, 40 }, { tail, 60 } };
+        TEST_ASSERT_TRUE(ram.writeData(exact, 2));
+        ref.insert(ref.end(), head, head + 40);
+        ref.insert(ref.end(), tail, tail + 60);
+        TEST_ASSERT_EQUAL_UINT32(0, ram.freeBytes());
+        TxSegment one[1] = { { head, 1 } };
+        TEST_ASSERT_FALSE(ram.writeData(one, 1));
+        TEST_ASSERT_EQUAL_UINT32(TEST_RAM_SIZE, ram.usedBytes());
+
+        // Read it all back: the refused record left nothing behind
+        while (!ref.empty()){
+            int got = ram.readData(buf, sizeof(buf));
+            TEST_ASSERT_GREATER_THAN(0, got);
+            for (int i = 0; i < got; i++) TEST_ASSERT_EQUAL_UINT8(ref[i], buf[i]);
+            ref.erase(ref.begin(), ref.begin() + got);
+            ram.poll();
+        }
+        TEST_ASSERT_EQUAL_UINT32(0, ram.usedBytes());
+        faults.check();
+    }
+
+    /**
+     * @brief What the chip and the reader saw in one run of transportWorkload().
+     */
+    struct TransportRun {
+        std::vector<std::vector<uint8_t> > programs;
+        std::vector<uint8_t> reads;
+        std::vector<uint8_t> image;
+    };
+
+    /**
+     * @brief A seeded mix of stored cycles, replay sized reads, polls and idle time, long enough to take the queue
+     * once around the array. The sequence only depends on the seed, not on timing, so both transports get the same one.
+     */
+    void transportWorkload(EepromTransport transport, TransportRun& run){
+        begin(transport);
+        ChipFaults faults;
+        hal::sim::spi_trace_enable(true);
+        rng = EEPROM_TEST_SEED;
+        static uint8_t buf[1024];
+        uint8_t next = 0;
+        for (int op = 0; op < 6000; op++){
+            uint32_t k = rnd() % 100;
+            if (k < 55){
+                uint32_t n = (rnd() & 1) ? TEST_RECORD_LEN : 1 + rnd() % 600;
+                for (uint32_t i = 0; i < n; i++) buf[i] = next++;
+                if (!ram.writeData(buf, n)) next -= n;
+            } else if (k < 85){
+                int got = ram.readData(buf, 1 + rnd() % 600);
+                run.reads.insert(run.reads.end(), buf, buf + got);
+            } else if (k < 95){
+                ram.poll();
+            } else {
+                hal::sim::advance_ns((rnd() % 8000) * 1000ULL);
+            }
+        }
+        while (ram.poll() || hal::sim::eeprom().busy()) hal::sim::advance_ns(SIM_EEPROM_WRITE_CYCLE_NS / 4);
+        hal::sim::spi_trace_enable(false);
+        faults.check();
+        run.programs = commands(WRITE_PAGE);
+        run.image = hal::sim::eeprom().memory;
+    }
+
+    /**
+     * @brief Random writes (flat and vectored), reads, polls and idle time, checked after every step against a
+     * std::deque holding what the queue should hold. Phases of mostly writing and mostly reading push the queue to
+     * full and back to empty over and over, so mem_start and mem_end wrap around the array and reads come to be split
+     * where it ends.
+     */
+    void fifoProperty(EepromTransport transport){
+        begin(transport);
+        ChipFaults faults;
+        hal::sim::AT25M02Model& chip = hal::sim::eeprom();
+        uint64_t pages_before = chip.page_writes;
+        rng = EEPROM_TEST_SEED;
+
+        std::deque<uint8_t> ref;
+        static uint8_t buf[4096];
+        char msg[96];
+        uint8_t next = 0;
+        int phase = 0;  // 0 mostly writes, 1 mostly reads, 2 balanced
+        for (long op = 0; op < EEPROM_TEST_OPS; op++){
+            if (op % 20000 == 0) phase = rnd() % 3;
+            uint32_t write_percent = phase == 0 ? 70 : phase == 1 ? 25 : 48;
+            uint32_t k = rnd() % 100;
+            if (k < write_percent){
+                uint32_t n = 1 + rnd() % (rnd() % 8 == 0 ? 1500 : 300);
+                for (uint32_t i = 0; i < n; i++) buf[i] = next++;
+                bool ok;
+                if (rnd() & 1){
+                    TxSegment segments[4];
+                    size_t count = 0;
+                    uint32_t offset = 0;
+                    while (offset < n && count < 3){
+                        uint32_t length = 1 + rnd() % (n - offset);
+                        segments[count].data = buf + offset;
+                        segments[count].length = length;
+                        offset += length;
+                        count++;
+                    }
+                    if (offset < n){
+                        segments[count].data = buf + offset;
+                        segments[count].length = n - offset;
+                        count++;
+                    }
+                    ok = ram.writeData(segments, count);
+                } else {
+                    ok = ram.writeData(buf, n);
+                }
+                if (ok){
+                    ref.insert(ref.end(), buf, buf + n);
+                } else {
+                    next -= n;
+                    snprintf(msg, sizeof(msg), "op %ld: %u byte write refused with %u bytes queued", op, n,
+                             (unsigned)ref.size());
+                    TEST_ASSERT_TRUE_MESSAGE(ref.size() + n > TEST_RAM_SIZE, msg);
+                }
+            } else if (k < 95){
+                uint32_t n = 1 + rnd() % (rnd() % 8 == 0 ? 3000 : 400);
+                uint32_t want = n < ref.size() ? n : ref.size();
+                int got = ram.readData(buf, n);
+                snprintf(msg, sizeof(msg), "op %ld: read %d bytes of %u", op, got, want);
+                TEST_ASSERT_EQUAL_INT_MESSAGE(want, got, msg);
+                for (uint32_t i = 0; i < want; i++){
+                    if (buf[i] != ref[i]){
+                        snprintf(msg, sizeof(msg), "op %ld: byte %u of a %u byte read differs", op, i, want);
+                        TEST_FAIL_MESSAGE(msg);
+                    }
+                }
+                ref.erase(ref.begin(), ref.begin() + want);
+            } else if (k < 98){
+                ram.poll();
+            } else {
+                hal::sim::advance_ns((rnd() % 8000) * 1000ULL);
+            }
+            if (ram.usedBytes() != ref.size()){
+                snprintf(msg, sizeof(msg), "op %ld: usedBytes %u, reference holds %u", op, ram.usedBytes(),
+                         (unsigned)ref.size());
+                TEST_FAIL_MESSAGE(msg);
+            }
+        }
+        faults.check();
+
+        double passes = (chip.page_writes - pages_before) * 256.0 / TEST_RAM_SIZE;
+        snprintf(msg, sizeof(msg), "%ld ops, %.1f passes over the array", (long)EEPROM_TEST_OPS, passes);
+        TEST_MESSAGE(msg);
+        // Short runs (a smaller EEPROM_TEST_OPS) may not get around the array
+        if (EEPROM_TEST_OPS >= 200000) TEST_ASSERT_TRUE_MESSAGE(passes >= 2.0, "the queue never wrapped");
+    }
+}
+
+void setUp(){}
+void tearDown(){}
+
+void test_read_ahead_gpio_cs(){
+    readAhead(EepromTransport::GPIO_CS);
+}
+
+#if AT25M02_DMA
+void test_read_ahead_hw_cs_dma(){
+    readAhead(EepromTransport::HW_CS_DMA);
+}
+#endif
+
+void test_vectored_write_near_full_gpio_cs(){
+    vectoredNearFull(EepromTransport::GPIO_CS);
+}
+
+#if AT25M02_DMA
+void test_vectored_write_near_full_hw_cs_dma(){
+    vectoredNearFull(EepromTransport::HW_CS_DMA);
+}
+#endif
+
+#if AT25M02_DMA
+void test_dma_matches_gpio_cs(){
+    TransportRun gpio;
+    TransportRun dma;
+    transportWorkload(EepromTransport::GPIO_CS, gpio);
+    transportWorkload(EepromTransport::HW_CS_DMA, dma);
+
+    // Every page program, address and 256 data bytes, the same and in the same order
+    TEST_ASSERT_GREATER_THAN(TEST_RAM_SIZE / TEST_PAGE_LEN, gpio.programs.size());
+    TEST_ASSERT_EQUAL_UINT32(gpio.programs.size(), dma.programs.size());
+    for (size_t p = 0; p < gpio.programs.size(); p++){
+        TEST_ASSERT_EQUAL_UINT32(gpio.programs[p].size(), dma.programs[p].size());
+        TEST_ASSERT_EQUAL_UINT8_ARRAY(&gpio.programs[p][0], &dma.programs[p][0], gpio.programs[p].size());
+    }
+    // Everything READ back, through the read-ahead or not
+    TEST_ASSERT_EQUAL_UINT32(gpio.reads.size(), dma.reads.size());
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(&gpio.reads[0], &dma.reads[0], gpio.reads.size());
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(&gpio.image[0], &dma.image[0], TEST_RAM_SIZE);
+}
+#endif
+
+void test_fifo_property_gpio_cs(){
+    fifoProperty(EepromTransport::GPIO_CS);
+}
+
+#if AT25M02_DMA
+void test_fifo_property_hw_cs_dma(){
+    fifoProperty(EepromTransport::HW_CS_DMA);
+}
+#endif
+
+void test_page_programs_in_order_gpio_cs(){
+    pageOrder(EepromTransport::GPIO_CS);
+}
+
+#if AT25M02_DMA
+void test_page_programs_in_order_hw_cs_dma(){
+    pageOrder(EepromTransport::HW_CS_DMA);
+}
+#endif
+
+int main(int argc, char** argv){
+    UNITY_BEGIN();
+    RUN_TEST(test_page_programs_in_order_gpio_cs);
+    RUN_TEST(test_read_ahead_gpio_cs);
+    RUN_TEST(test_vectored_write_near_full_gpio_cs);
+    RUN_TEST(test_fifo_property_gpio_cs);
+#if AT25M02_DMA
+    RUN_TEST(test_page_programs_in_order_hw_cs_dma);
+    RUN_TEST(test_read_ahead_hw_cs_dma);
+    RUN_TEST(test_vectored_write_near_full_hw_cs_dma);
+    RUN_TEST(test_dma_matches_gpio_cs);
+    RUN_TEST(test_fifo_property_hw_cs_dma);
+#endif
+    return UNITY_END();
+}
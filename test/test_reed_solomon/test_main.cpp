@@ -0,0 +1,154 @@
+/**
+ * @file test_main.cpp
+ * @brief Host tests for the Reed-Solomon code of Framing::REED_SOLOMON: RsEncoder on the shield, rsDecode on the ground.
+ *
+ *     pio test -e native -f test_reed_solomon
+ */
+#include <unity.h>
+#include <ReedSolomon.hpp>
+#include <Telemetry.hpp>
+#include <stdio.h>
+#include <string.h>
+
+// Blocks tried for each block length and number of errors
+#ifndef RS_TEST_TRIALS
+#define RS_TEST_TRIALS 2000
+#endif
+#ifndef RS_TEST_SEED
+#define RS_TEST_SEED 12345u
+#endif
+
+namespace {
+    uint32_t rng;
+
+    uint32_t rnd(){
+        rng ^= rng << 13;
+        rng ^= rng >> 17;
+        rng ^= rng << 5;
+        return rng;
+    }
+
+    // Data lengths of the records that go out with parity, and the longest block the code allows
+    const size_t LENGTHS[] = { SweepRecord::size, ImuRecord::size, HousekeepingRecord::size, RS_BLOCK_MAX - RS_PARITY };
+
+    /**
+     * @brief Random data of the given length, its parity from RsEncoder after it. The data goes in two pieces, like a
+     * record's segments.
+     */
+    void encodeBlock(uint8_t* block, size_t length){
+        for (size_t i = 0; i < length; i++) block[i] = (uint8_t)rnd();
+        RsEncoder encoder;
+        size_t split = rnd() % (length + 1);
+        encoder.put(block, split);
+        encoder.put(block + split, length - split);
+        uint8_t parity[RS_PARITY];
+        encoder.finish(parity);
+        memcpy(block + length, parity, RS_PARITY);
+    }
+
+    /**
+     * @brief Changes errors bytes at different places anywhere in the block, parity included.
+     */
+    void damage(uint8_t* block, size_t size, int errors){
+        bool hit[RS_BLOCK_MAX] = {};
+        for (int e = 0; e < errors; e++){
+            size_t at;
+            do at = rnd() % size; while (hit[at]);
+            hit[at] = true;
+            block[at] ^= (uint8_t)(1 + rnd() % 255);
+        }
+    }
+}
+
+void setUp(){}
+void tearDown(){}
+
+// A block straight from the encoder is a codeword: nothing to correct
+void test_encoder_output_decodes_clean(){
+    rng = RS_TEST_SEED;
+    uint8_t block[RS_BLOCK_MAX];
+    uint8_t sent[RS_BLOCK_MAX];
+    for (size_t length : LENGTHS){
+        for (int trial = 0; trial < RS_TEST_TRIALS; trial++){
+            encodeBlock(block, length);
+            memcpy(sent, block, length + RS_PARITY);
+            TEST_ASSERT_EQUAL_INT(0, rsDecode(block, length + RS_PARITY));
+            TEST_ASSERT_EQUAL_UINT8_ARRAY(sent, block, length + RS_PARITY);
+        }
+    }
+}
+
+// 1 to RS_PARITY / 2 bad bytes anywhere in the block are all repaired, and counted
+void test_corrects_up_to_half_the_parity(){
+    rng = RS_TEST_SEED;
+    uint8_t block[RS_BLOCK_MAX];
+    uint8_t sent[RS_BLOCK_MAX];
+    char msg[64];
+    for (size_t length : LENGTHS){
+        for (int errors = 1; errors <= RS_PARITY / 2; errors++){
+            for (int trial = 0; trial < RS_TEST_TRIALS; trial++){
+                encodeBlock(block, length);
+                memcpy(sent, block, length + RS_PARITY);
+                damage(block, length + RS_PARITY, errors);
+                snprintf(msg, sizeof(msg), "%u byte block, %d errors, trial %d", (unsigned)(length + RS_PARITY), errors,
+                         trial);
+                TEST_ASSERT_EQUAL_INT_MESSAGE(errors, rsDecode(block, length + RS_PARITY), msg);
+                TEST_ASSERT_EQUAL_UINT8_ARRAY(sent, block, length + RS_PARITY);
+            }
+        }
+    }
+}
+
+/*
+ * One more bad byte than the code can correct. No decoder can catch all of these: the received block can land within
+ * RS_PARITY / 2 bytes of another codeword, and then the nearest codeword is the wrong one. rsDecode must report every
+ * other block, leaving it as it came in. A block it does take has to be a codeword RS_PARITY + 1 or more bytes from the one
+ * sent, which is the code's limit and not a decoding mistake, and that has to happen no more often than it does for an
+ * ideal bounded distance decoder: about C(n, t) 255^t / 256^2t of the time, for t = RS_PARITY / 2 and an n byte block
+ * (0.24% for a ##S block, 3.9% for a full 255 byte one).
+ */
+void test_detects_one_error_too_many(){
+    rng = RS_TEST_SEED;
+    uint8_t block[RS_BLOCK_MAX];
+    uint8_t sent[RS_BLOCK_MAX];
+    uint8_t received[RS_BLOCK_MAX];
+    char msg[96];
+    for (size_t length : LENGTHS){
+        size_t size = length + RS_PARITY;
+        int undetected = 0;
+        for (int trial = 0; trial < RS_TEST_TRIALS; trial++){
+            encodeBlock(block, length);
+            memcpy(sent, block, size);
+            damage(block, size, RS_PARITY / 2 + 1);
+            memcpy(received, block, size);
+            int corrected = rsDecode(block, size);
+            if (corrected < 0){
+                TEST_ASSERT_EQUAL_UINT8_ARRAY(received, block, size);
+                continue;
+            }
+            undetected++;
+            int distance = 0;
+            for (size_t i = 0; i < size; i++) distance += block[i] != sent[i];
+            snprintf(msg, sizeof(msg), "%u byte block, trial %d: took a block %d bytes from the one sent", (unsigned)size,
+                     trial, distance);
+            TEST_ASSERT_TRUE_MESSAGE(corrected <= RS_PARITY / 2 && distance > RS_PARITY, msg);
+            TEST_ASSERT_EQUAL_INT_MESSAGE(0, rsDecode(block, size), msg);
+        }
+        // Share of received words within t of some codeword: spheres of C(n, t) 255^t words around each of 256^(n - 2t)
+        // codewords, out of 256^n words
+        double expected = 1.0;
+        for (int i = 0; i < RS_PARITY / 2; i++) expected *= (double)(size - i) / (i + 1) * 255.0 / 65536.0;
+        snprintf(msg, sizeof(msg), "%u byte blocks with %d errors: %d of %d not detected, about %.0f expected",
+                 (unsigned)size, RS_PARITY / 2 + 1, undetected, RS_TEST_TRIALS, expected * RS_TEST_TRIALS);
+        TEST_MESSAGE(msg);
+        TEST_ASSERT_TRUE_MESSAGE(undetected <= 2.0 * expected * RS_TEST_TRIALS + 3, msg);
+    }
+}
+
+int main(int argc, char** argv){
+    UNITY_BEGIN();
+    RUN_TEST(test_encoder_output_decodes_clean);
+    RUN_TEST(test_corrects_up_to_half_the_parity);
+    RUN_TEST(test_detects_one_error_too_many);
+    return UNITY_END();
+}
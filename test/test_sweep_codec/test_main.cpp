@@ -0,0 +1,152 @@
+/**
+ * @file test_main.cpp
+ * @brief Host tests for the Rice coding of sweeps (SweepCoding::RICE): sweepEncode on the shield, sweepDecode on the ground.
+ *
+ *     pio test -e native -f test_sweep_codec
+ */
+#include <unity.h>
+#include <SweepCodec.hpp>
+#include <Telemetry.hpp>
+#include <stdio.h>
+#include <string.h>
+
+// Sweeps tried of each kind and size
+#ifndef CODEC_TEST_SWEEPS
+#define CODEC_TEST_SWEEPS 2000
+#endif
+#ifndef CODEC_TEST_SEED
+#define CODEC_TEST_SEED 12345u
+#endif
+// Longest coded sweep: per probe the header and step 0, then every residual escaped
+#define CODEC_TEST_MAX_STEPS 256
+#define CODEC_TEST_MAX_PROBES 4
+#define CODEC_TEST_CAPACITY (CODEC_TEST_MAX_PROBES * (1 + SWEEP_RICE_K_BITS + 16 \
+                             + CODEC_TEST_MAX_STEPS * (SWEEP_RICE_ESCAPE + SWEEP_RESIDUAL_BITS)) / 8 + 1)
+
+namespace {
+    uint32_t rng;
+
+    uint32_t rnd(){
+        rng ^= rng << 13;
+        rng ^= rng >> 17;
+        rng ^= rng << 5;
+        return rng;
+    }
+
+    struct Size {
+        size_t steps;
+        size_t probes;
+    };
+    // As built, then other sweeps the coder has to handle
+    const Size SIZES[] = { { SWEEP_STEPS, SWEEP_PROBES }, { 2, 1 }, { 64, 4 }, { 256, 2 } };
+
+    enum Kind {
+        SMOOTH,     // Langmuir-like curve shared by the probes, plus a little noise: what flight sweeps look like
+        NOISE,      // every sample random, 16 bits
+        EXTREMES,   // every sample 0 or 65535, so predictions clamp and residuals escape
+        NUM_KINDS
+    };
+
+    void makeSweep(Kind kind, const Size& size, uint16_t* sweep){
+        for (size_t p = 0; p < size.probes; p++){
+            int offset = (int)(rnd() % 2000);
+            for (size_t i = 0; i < size.steps; i++){
+                uint16_t& x = sweep[p * size.steps + i];
+                if (kind == NOISE){
+                    x = (uint16_t)rnd();
+                } else if (kind == EXTREMES){
+                    x = (rnd() & 1) ? 0xFFFF : 0;
+                } else {
+                    double v = 1500.0 + 9000.0 * i / (size.steps - 1 + 1.0) + offset;
+                    x = (uint16_t)((int)v + (int)(rnd() % 17) - 8) & 0x3FFF;
+                }
+            }
+        }
+    }
+
+    /**
+     * @brief Codes and decodes the sweep with room for the longest coded sweep, and checks it comes back exactly.
+     * Returns the coded length.
+     */
+    size_t roundTrip(const uint16_t* sweep, const Size& size){
+        static uint8_t coded[CODEC_TEST_CAPACITY];
+        static uint16_t decoded[CODEC_TEST_MAX_STEPS * CODEC_TEST_MAX_PROBES];
+        size_t samples = size.steps * size.probes;
+        size_t length = sweepEncode(sweep, size.steps, size.probes, coded, sizeof(coded));
+        TEST_ASSERT_GREATER_THAN(0, length);
+        memset(decoded, 0xA5, sizeof(decoded));
+        TEST_ASSERT_TRUE(sweepDecode(coded, length, size.steps, size.probes, decoded));
+        TEST_ASSERT_EQUAL_UINT16_ARRAY(sweep, decoded, samples);
+        // Exactly one coded sweep: a byte short does not decode
+        TEST_ASSERT_FALSE(sweepDecode(coded, length - 1, size.steps, size.probes, decoded));
+        return length;
+    }
+}
+
+void setUp(){}
+void tearDown(){}
+
+// Every kind of sweep, at every size, decodes to exactly what was coded
+void test_lossless(){
+    rng = CODEC_TEST_SEED;
+    static uint16_t sweep[CODEC_TEST_MAX_STEPS * CODEC_TEST_MAX_PROBES];
+    for (const Size& size : SIZES){
+        for (int kind = 0; kind < NUM_KINDS; kind++){
+            for (int n = 0; n < CODEC_TEST_SWEEPS; n++){
+                makeSweep((Kind)kind, size, sweep);
+                roundTrip(sweep, size);
+            }
+        }
+    }
+}
+
+// Steps that swing from one end of the range to the other: the largest residuals there are, every one escaped
+void test_lossless_worst_case(){
+    static uint16_t sweep[CODEC_TEST_MAX_STEPS * CODEC_TEST_MAX_PROBES];
+    for (const Size& size : SIZES){
+        size_t samples = size.steps * size.probes;
+        for (size_t i = 0; i < samples; i++) sweep[i] = (i % 2) ? 0xFFFF : 0;
+        roundTrip(sweep, size);
+        for (size_t i = 0; i < samples; i++) sweep[i] = ((i / 2) % 2) ? 0xFFFF : 0;
+        roundTrip(sweep, size);
+        for (size_t i = 0; i < samples; i++) sweep[i] = (i % size.steps) ? 0 : 0xFFFF;
+        roundTrip(sweep, size);
+    }
+}
+
+/*
+ * codeSweep() in main.cpp gives sweepEncode SWEEP_CODED_MAX bytes, less than a raw ##S sweep, and sends the sweep raw when it gets 0.
+ * Shipped size sweeps that would not code shorter must get 0, flight-like ones must code, and the cut is exact: a sweep
+ * that codes to n bytes codes with room for n and gets 0 with n - 1.
+ */
+void test_falls_back_to_raw(){
+    rng = CODEC_TEST_SEED;
+    const Size& shipped = SIZES[0];
+    uint16_t sweep[SweepField::count];
+    uint8_t coded[SWEEP_CODED_MAX];
+    int smooth_raw = 0;
+    for (int kind = 0; kind < NUM_KINDS; kind++){
+        for (int n = 0; n < CODEC_TEST_SWEEPS; n++){
+            makeSweep((Kind)kind, shipped, sweep);
+            size_t full = roundTrip(sweep, shipped);
+            size_t length = sweepEncode(sweep, shipped.steps, shipped.probes, coded, SWEEP_CODED_MAX);
+            if (full > SWEEP_CODED_MAX){
+                TEST_ASSERT_EQUAL_UINT32(0, length);
+            } else {
+                TEST_ASSERT_EQUAL_UINT32(full, length);
+                TEST_ASSERT_EQUAL_UINT32(0, sweepEncode(sweep, shipped.steps, shipped.probes, coded, full - 1));
+            }
+            if (kind == SMOOTH && length == 0) smooth_raw++;
+            if (kind != SMOOTH) TEST_ASSERT_EQUAL_UINT32(0, length);
+        }
+    }
+    TEST_ASSERT_EQUAL_INT(0, smooth_raw);
+}
+
+int main(int argc, char** argv){
+    UNITY_BEGIN();
+    RUN_TEST(test_lossless);
+    RUN_TEST(test_lossless_worst_case);
+    RUN_TEST(test_falls_back_to_raw);
+    return UNITY_END();
+}
@@ -0,0 +1,131 @@
+/**
+ * @file test_main.cpp
+ * @brief Host tests for SweepTable: the compile-time DAC codes against the double arithmetic the sweep used to do at run
+ * time.
+ *
+ *     pio test -e native -f test_sweep_table
+ *
+ * Rebuild with e.g. -DSWEEP_STEPS=64 -DSWEEP_AVERAGES=16 -DSWEEP_TEST_STEP_PERIOD_US=400 to check a differently sized
+ * sweep.
+ */
+#include <unity.h>
+#include <SweepConfig.hpp>
+#include <SweepTable.hpp>
+#include <HALSim.hpp>
+#include <stdio.h>
+
+// SWEEP_STEP_PERIOD in main.cpp. More averages need longer steps, so set both when rebuilding with another SWEEP_AVERAGES.
+#ifndef SWEEP_TEST_STEP_PERIOD_US
+#define SWEEP_TEST_STEP_PERIOD_US 401
+#endif
+
+//========== From main.cpp ==========//
+void setup();
+extern SweepController pipController;
+
+namespace {
+    /**
+     * @brief A Max1148 that converts exactly the code on the DAC its channel watches (CHAN2 DAC0, CHAN1 DAC1, like the
+     * shield), with no probe response and no noise.
+     */
+    class EchoAdc : public hal::sim::Max1148Model {
+    public:
+        uint16_t sample(int channel){
+            if (channel == 2) return (uint16_t)hal::sim::dac_value(DAC0);
+            if (channel == 1) return (uint16_t)hal::sim::dac_value(DAC1);
+            return 0;
+        }
+    };
+
+    /**
+     * @brief The old loop, as PipController::sweep() and set_dac_stepping() ran it before SweepTable: a double step,
+     * added once per step and truncated to int for the DAC.
+     */
+    void runtimeCodes(uint16_t min, uint16_t max, uint16_t steps, uint16_t* codes){
+        double value = min;
+        double step = (double)(max - min) / (double)(steps - 1);
+        for (int i = 0; i < steps; i++){
+            codes[i] = (uint16_t)(int)value;
+            value += step;
+        }
+    }
+
+    template <uint16_t Min, uint16_t Max, uint16_t Steps>
+    void checkTable(){
+        uint16_t expected[Steps];
+        runtimeCodes(Min, Max, Steps, expected);
+        char msg[64];
+        for (int i = 0; i < Steps; i++){
+            snprintf(msg, sizeof(msg), "%u..%u in %u steps, step %d", Min, Max, Steps, i);
+            TEST_ASSERT_EQUAL_UINT16_MESSAGE(expected[i], (SweepTable<Min, Max, Steps>::codes[i]), msg);
+        }
+    }
+
+    /**
+     * @brief checkTable for every step count from 2 to Steps.
+     */
+    template <uint16_t Min, uint16_t Max, uint16_t Steps>
+    struct CheckStepCounts {
+        static void run(){
+            CheckStepCounts<Min, Max, Steps - 1>::run();
+            checkTable<Min, Max, Steps>();
+        }
+    };
+
+    template <uint16_t Min, uint16_t Max>
+    struct CheckStepCounts<Min, Max, 1> {
+        static void run(){}
+    };
+}
+
+void setUp(){}
+void tearDown(){}
+
+// The table main.cpp gives pip0 and pip1, as built
+void test_shipped_sweep(){
+    checkTable<339, 3752, SWEEP_STEPS>();
+}
+
+/*
+ * main.cpp's pipController sweeping with an ADC that reads back exactly what each DAC is putting out: every step of
+ * every probe, averaged SWEEP_AVERAGES times, has to come out as the old loop's code. Results are 14 bits, left
+ * justified, so a 12-bit code reads back times four.
+ */
+void test_shipped_sweep_reaches_the_dacs(){
+    setup();
+    static EchoAdc echo;
+    hal::sim::attach_spi_device(ADC_CS_PIN, &echo);
+    uint16_t expected[SWEEP_STEPS];
+    runtimeCodes(339, 3752, SWEEP_STEPS, expected);
+    const DacStepping modes[] = { DacStepping::CPU, DacStepping::TIMER };
+    for (DacStepping mode : modes){
+        pipController.set_dac_stepping(mode, SWEEP_TEST_STEP_PERIOD_US);
+        uint16_t data[SweepController::SWEEP_SAMPLES];
+        pipController.sweep(data);
+        for (size_t i = 0; i < SweepController::SWEEP_SAMPLES; i++){
+            TEST_ASSERT_EQUAL_UINT16(expected[i % SWEEP_STEPS] << 2, data[i]);
+        }
+    }
+    hal::sim::attach_spi_device(ADC_CS_PIN, &hal::sim::adc());
+}
+
+void test_other_step_counts(){
+    checkTable<339, 3752, 64>();
+    CheckStepCounts<339, 3752, SWEEP_MAX_SAMPLES>::run();
+}
+
+// The full DAC range, and a narrow one like the per shield ranges in sweep_values_v5_1.h, where the step is under 8
+// codes and rounding matters most
+void test_other_ranges(){
+    CheckStepCounts<0, 4095, SWEEP_MAX_SAMPLES>::run();
+    CheckStepCounts<1814, 2576, SWEEP_MAX_SAMPLES>::run();
+}
+
+int main(int argc, char** argv){
+    UNITY_BEGIN();
+    RUN_TEST(test_shipped_sweep);
+    RUN_TEST(test_shipped_sweep_reaches_the_dacs);
+    RUN_TEST(test_other_step_counts);
+    RUN_TEST(test_other_ranges);
+    return UNITY_END();
+}